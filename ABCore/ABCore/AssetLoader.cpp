@@ -0,0 +1,209 @@
+#include "AssetLoader.h"
+#include "GameObject.h"
+#include "Scene.h"
+#include "TextureCache.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace AB;
+
+AssetLoader* AssetLoader::instance;
+
+// uploads waiting for the GL thread; a worker with more to queue waits for Update to catch up
+#define MAX_QUEUED_UPLOADS 32
+
+AssetLoader::AssetLoader()
+{
+	// leave a core for the GL thread
+	unsigned int workerCount = max(thread::hardware_concurrency(), 2u) - 1;
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.emplace_back(&AssetLoader::WorkerLoop, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		lock_guard<mutex> jobLock(jobMutex);
+		lock_guard<mutex> uploadLock(uploadMutex);
+		stopping = true;
+	}
+	jobAdded.notify_all();
+	uploadTaken.notify_all();
+
+	for (thread& worker : workers)
+		worker.join();
+}
+
+void AssetLoader::WorkerLoop()
+{
+	while (true)
+	{
+		function<void()> job;
+		{
+			unique_lock<mutex> lock(jobMutex);
+			jobAdded.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+
+			job = move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void AssetLoader::QueueJob(function<void()> job)
+{
+	{
+		lock_guard<mutex> lock(jobMutex);
+		jobs.push_back(move(job));
+	}
+	jobAdded.notify_one();
+}
+
+void AssetLoader::QueueUpload(function<void()> upload)
+{
+	unique_lock<mutex> lock(uploadMutex);
+	uploadTaken.wait(lock, [this] { return stopping || uploads.size() < MAX_QUEUED_UPLOADS; });
+	if (stopping)
+		return;
+
+	uploads.push_back(move(upload));
+}
+
+void AssetLoader::Update()
+{
+	auto start = chrono::steady_clock::now();
+	while (true)
+	{
+		function<void()> upload;
+		{
+			lock_guard<mutex> lock(uploadMutex);
+			if (uploads.empty())
+				break;
+
+			upload = move(uploads.front());
+			uploads.pop_front();
+		}
+		uploadTaken.notify_one();
+		upload();
+
+		if (chrono::duration<float, milli>(chrono::steady_clock::now() - start).count() >= uploadBudgetMs)
+			break;
+	}
+}
+
+shared_ptr<Mesh> AssetLoader::CreatePlaceholderMesh()
+{
+	if (!placeholderCube.GetVAO())
+	{
+		// unit cube, one quad per face so every face has its own normal
+		for (int face = 0; face < 6; face++)
+		{
+			glm::vec3 normal(0.f);
+			normal[face / 2] = face % 2 ? -1.f : 1.f;
+			glm::vec3 u(0.f), v(0.f);
+			u[(face / 2 + 1) % 3] = 0.5f;
+			v[(face / 2 + 2) % 3] = face % 2 ? -0.5f : 0.5f;
+
+			unsigned int first = (unsigned int)placeholderCube.vertices.size();
+			placeholderCube.vertices.push_back({ normal * 0.5f - u - v, normal, glm::vec2(0.f, 0.f) });
+			placeholderCube.vertices.push_back({ normal * 0.5f + u - v, normal, glm::vec2(1.f, 0.f) });
+			placeholderCube.vertices.push_back({ normal * 0.5f + u + v, normal, glm::vec2(1.f, 1.f) });
+			placeholderCube.vertices.push_back({ normal * 0.5f - u + v, normal, glm::vec2(0.f, 1.f) });
+
+			unsigned int quad[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+			placeholderCube.indices.insert(placeholderCube.indices.end(), quad, quad + 6);
+		}
+		placeholderCube.RefreshBuffers();
+	}
+
+	// copies share the cube's geometry in the arena but are distinct meshes, so each load replaces only its own
+	return make_shared<Mesh>(placeholderCube);
+}
+
+vector<shared_ptr<Mesh>> AssetLoader::LoadModel(const string& path, function<void(vector<shared_ptr<Mesh>>&)> onLoaded)
+{
+	shared_ptr<Mesh> placeholder = CreatePlaceholderMesh();
+	pending++;
+
+	// onLoaded and the loaded meshes are moved along rather than copied, so the worker never holds the last
+	// reference to anything with GL objects in it and everything is released on the GL thread
+	VertexFormat format = vertexFormat;
+	QueueJob([this, path, format, onLoaded = move(onLoaded), placeholder]() mutable
+	{
+		// shared so every upload step below can get at it
+		auto meshes = make_shared<vector<Mesh>>(LoadModelMeshes(path, false));
+		auto loaded = make_shared<vector<shared_ptr<Mesh>>>();
+		string directory = path.substr(0, path.find_last_of('/'));
+
+		// one mesh per upload, so a big model is spread over frames
+		for (size_t i = 0; i < meshes->size(); i++)
+		{
+			QueueUpload([this, meshes, loaded, directory, format, i]()
+			{
+				Mesh& mesh = (*meshes)[i];
+				for (Texture& texture : mesh.textures)
+				{
+					if (!texture.id)
+						texture = LoadTexture(texture.type, texture.path, directory);
+				}
+				mesh.vertexFormat = format;
+				mesh.RefreshBuffers();
+				loaded->push_back(make_shared<Mesh>(move(mesh)));
+			});
+		}
+
+		QueueUpload([this, loaded = move(loaded), onLoaded = move(onLoaded), placeholder]()
+		{
+			if (onLoaded)
+				onLoaded(*loaded);
+			Scene::Get().ReplaceMesh(placeholder, *loaded);
+			pending--;
+		});
+	});
+
+	return { placeholder };
+}
+
+Texture AssetLoader::LoadTexture(const string& typeName, const string& path, const string& directory)
+{
+	// the cache hands out the same texture to everyone who asks, whether it's loaded yet or not
+	bool created;
+	Texture texture = TextureCache::Get().Acquire(typeName, path, directory, TextureSampler(), created);
+	if (!created)
+		return texture;
+
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	TextureCache::Upload(texture.id, white, 1, 1, 4);
+	pending++;
+
+	// only GL thread code may hold the last reference, so the worker gets a weak one
+	weak_ptr<TextureResource> resource = texture.resource;
+	string filename = directory + '/' + path;
+	bool compress = TextureCache::Get().compressTextures;
+	QueueJob([this, resource, filename, typeName, compress]()
+	{
+		// decoded, or read from (or converted to) its .dds
+		auto image = make_shared<TextureImage>();
+		bool loaded = LoadTextureImage(filename, typeName, compress, *image);
+
+		QueueUpload([this, resource, filename, image, loaded]()
+		{
+			// skip textures everyone has let go of in the meantime
+			shared_ptr<TextureResource> alive = resource.lock();
+			if (alive && loaded)
+				TextureCache::Upload(alive->id, *image, alive->sampler);
+			else if (!loaded)
+				cout << "Texture failed to load at path: " << filename << endl;
+
+			pending--;
+		});
+	});
+
+	return texture;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Mesh.h"
+
+namespace AB
+{
+	// Singleton that loads models and textures in the background.
+	// Worker threads do the file I/O, the Assimp import (or mesh cache read) and the image decoding. What needs GL
+	// is queued for the GL thread, which runs it from Update within a per-frame time budget.
+	//
+	// Loads return placeholders right away: models a small cube mesh that every GameObject using it has
+	// replaced with the real meshes once they're uploaded, textures a 1x1 white texture whose contents are
+	// replaced in place, so whatever holds the Texture keeps it.
+	class AssetLoader
+	{
+	public:
+
+		static AssetLoader& Get()
+		{
+			if (!instance)
+				instance = new AssetLoader();
+			return *instance;
+		}
+
+		AssetLoader(AssetLoader const&) = delete;
+		void operator=(AssetLoader const&) = delete;
+
+		// returns the placeholder meshes to build GameObjects with. onLoaded runs on the GL thread with the real
+		// meshes, before they're swapped in, e.g. to add textures the model file doesn't reference.
+		std::vector<std::shared_ptr<Mesh>> LoadModel(const std::string& path, std::function<void(std::vector<std::shared_ptr<Mesh>>&)> onLoaded = nullptr);
+
+		// returns a texture that is white until the image at directory/path has been decoded and uploaded
+		Texture LoadTexture(const std::string& typeName, const std::string& path, const std::string& directory);
+
+		// runs queued GL work until the frame's budget is used up; call once per frame on the GL thread
+		void Update();
+
+		// loads that haven't been fully uploaded yet
+		unsigned int GetPendingCount() const { return pending; }
+
+		// time Update may spend on uploads per frame. At least one upload runs every frame, however long it takes.
+		float uploadBudgetMs = 2.f;
+
+		// the format loaded models are uploaded in (see Mesh::vertexFormat)
+		VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+
+		~AssetLoader();
+
+	private:
+
+		static AssetLoader* instance;
+		AssetLoader();
+
+		void WorkerLoop();
+		void QueueJob(std::function<void()> job);
+		// hands GL work to Update; blocks while the upload queue is full, so workers can't run far ahead of it
+		void QueueUpload(std::function<void()> upload);
+		std::shared_ptr<Mesh> CreatePlaceholderMesh();
+
+		std::vector<std::thread> workers;
+
+		std::mutex jobMutex;
+		std::condition_variable jobAdded;
+		std::deque<std::function<void()>> jobs;
+
+		std::mutex uploadMutex;
+		std::condition_variable uploadTaken;
+		std::deque<std::function<void()>> uploads;
+
+		bool stopping = false;
+		// only touched on the GL thread
+		unsigned int pending = 0;
+		Mesh placeholderCube;
+	};
+}
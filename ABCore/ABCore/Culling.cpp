@@ -0,0 +1,146 @@
+#include "Culling.h"
+#include "Mesh.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+using namespace std;
+using namespace AB;
+
+void AABB::Add(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::Add(const AABB& other)
+{
+	if (other.IsEmpty()) return;
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+AABB AABB::FromVertices(const vector<Vertex>& vertices)
+{
+	AABB bounds;
+	for (const Vertex& v : vertices)
+		bounds.Add(v.Position);
+	return bounds;
+}
+
+AABB AABB::Transform(const glm::mat4& matrix) const
+{
+	if (IsEmpty()) return *this;
+
+	// the transformed extents along each world axis are the extents projected onto the absolute matrix rows
+	glm::vec3 center = glm::vec3(matrix * glm::vec4(GetCenter(), 1.f));
+	glm::vec3 extents = GetExtents();
+	glm::vec3 worldExtents;
+	for (int row = 0; row < 3; row++)
+	{
+		worldExtents[row] = glm::abs(matrix[0][row]) * extents.x +
+			glm::abs(matrix[1][row]) * extents.y +
+			glm::abs(matrix[2][row]) * extents.z;
+	}
+
+	AABB result;
+	result.min = center - worldExtents;
+	result.max = center + worldExtents;
+	return result;
+}
+
+Frustum::Frustum(const glm::mat4& m)
+{
+	// Gribb/Hartmann: each plane is the last row of the matrix plus or minus one of the others.
+	// glm is column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	planes[0] = rows[3] + rows[0]; // left
+	planes[1] = rows[3] - rows[0]; // right
+	planes[2] = rows[3] + rows[1]; // bottom
+	planes[3] = rows[3] - rows[1]; // top
+	planes[4] = rows[3] + rows[2]; // near
+	planes[5] = rows[3] - rows[2]; // far
+
+	for (glm::vec4& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+void FrustumCuller::Clear()
+{
+	count = 0;
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+unsigned int FrustumCuller::Add(const AABB& bounds)
+{
+	glm::vec3 center = glm::vec3(0.f);
+	// hugely negative extents put an empty box behind every plane
+	glm::vec3 extents = glm::vec3(-FLT_MAX);
+	if (!bounds.IsEmpty())
+	{
+		center = bounds.GetCenter();
+		extents = bounds.GetExtents();
+	}
+
+	centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+	extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+	return count++;
+}
+
+CullingStats FrustumCuller::Cull(const Frustum& frustum, vector<unsigned char>& visible) const
+{
+	visible.resize(count);
+
+	unsigned int i = 0;
+#ifdef CULLING_SSE
+	// a box is outside a plane when its center is further behind it than the box reaches towards it:
+	// dot(n, center) + d + dot(|n|, extents) < 0
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // all lanes true
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			__m128 dist = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y)));
+			dist = _mm_add_ps(dist, _mm_mul_ps(cz, _mm_set1_ps(plane.z)));
+			dist = _mm_add_ps(dist, _mm_set1_ps(plane.w));
+
+			__m128 reach = _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(glm::abs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(glm::abs(plane.y))));
+			reach = _mm_add_ps(reach, _mm_mul_ps(ez, _mm_set1_ps(glm::abs(plane.z))));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, reach), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+			visible[i + lane] = (mask >> lane) & 1;
+	}
+#endif
+
+	// whatever is left (or everything, without SSE)
+	for (; i < count; i++)
+	{
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			float dist = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+			float reach = glm::abs(plane.x) * extentX[i] + glm::abs(plane.y) * extentY[i] + glm::abs(plane.z) * extentZ[i];
+			inside &= dist + reach >= 0.f;
+		}
+		visible[i] = inside;
+	}
+
+	CullingStats stats;
+	for (unsigned char v : visible)
+		stats.visible += v;
+	stats.culled = count - stats.visible;
+	return stats;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cfloat>
+
+namespace AB
+{
+	struct Vertex;
+
+	// Axis-aligned bounding box. An empty box has min > max.
+	struct AABB
+	{
+		glm::vec3 min = glm::vec3(FLT_MAX);
+		glm::vec3 max = glm::vec3(-FLT_MAX);
+
+		bool IsEmpty() const { return min.x > max.x; }
+		glm::vec3 GetCenter() const { return (min + max) * 0.5f; }
+		glm::vec3 GetExtents() const { return (max - min) * 0.5f; }
+
+		void Add(const glm::vec3& point);
+		void Add(const AABB& other);
+
+		// bounds of the vertices' positions
+		static AABB FromVertices(const std::vector<Vertex>& vertices);
+		// bounds of this box after transforming it, which are at least as big as the transformed box
+		AABB Transform(const glm::mat4& matrix) const;
+	};
+
+	// The six planes of a view frustum, pointing inward, as (normal, distance)
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+
+		// extracts the planes from a projection * view matrix
+		Frustum(const glm::mat4& viewProjection);
+	};
+
+	struct CullingStats
+	{
+		unsigned int visible = 0;
+		unsigned int culled = 0;
+	};
+
+	// Tests many boxes against a frustum at once. Boxes are kept as structure-of-arrays (centers and extents
+	// per axis) so four of them are tested against a plane with a handful of SSE instructions.
+	class FrustumCuller
+	{
+	public:
+
+		// drops every box; call before adding this frame's
+		void Clear();
+		// adds a box and returns its index in the results of Cull
+		unsigned int Add(const AABB& bounds);
+
+		// fills visible with one entry per box: 1 if it touches the frustum, 0 if it's entirely outside.
+		// Empty boxes are never visible.
+		CullingStats Cull(const Frustum& frustum, std::vector<unsigned char>& visible) const;
+
+		unsigned int Size() const { return count; }
+
+	private:
+
+		unsigned int count = 0;
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+	};
+}
@@ -7,7 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Transform.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "NormalGenerator.h"
 #include <iostream>
+#include <chrono>
 
 using namespace std;
 using namespace AB;
@@ -19,114 +23,107 @@ using namespace AB;
 // 
 //////////////////////////////////////////////////////////////////////
 
-void LoadMaterialTextures(Mesh& mesh, aiMaterial* mat, aiTextureType type, string typeName, const string directory)
+// without upload the textures are only listed on the mesh, with id 0, for the caller to load
+void LoadMaterialTextures(Mesh& mesh, aiMaterial* mat, aiTextureType type, string typeName, const string directory, bool upload)
 {
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
 
-		bool skip = false;
-		/*for (unsigned int j = 0; j < texturesLoaded.size(); j++)
+		// AddTexture goes through the TextureCache, so textures shared between meshes are only loaded once
+		if (upload)
 		{
-			if (strcmp(texturesLoaded[j].path.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(texturesLoaded[j]);
-				skip = true;
-				break;
-			}
-		}*/
-		if (!skip) // if textures hasn't been loaded already, load it
-		{
-			mesh.AddTexture(typeName, str.C_Str(), directory);
-			//texturesLoaded.push_back(texture);
+			if (!mesh.AddTexture(typeName, str.C_Str(), directory))
+				cout << "ERROR: Drawing mesh without its " << typeName << " " << directory << '/' << str.C_Str() << endl;
 		}
+		else
+			mesh.textures.push_back({ 0, typeName, str.C_Str(), nullptr });
 	}
 }
 
-static Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene, const string directory)
+static Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene, const string directory, bool upload)
 {
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
 	Mesh newMesh;
 
-	// process vertices
+	// process vertices, straight into the mesh
+	vector<Vertex>& vertices = newMesh.vertices;
+	vertices.resize(mesh->mNumVertices);
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
-		Vertex vertex;
+		Vertex& vertex = vertices[i];
 
 		// process vertex positions, normals and texture coords
-		glm::vec3 vec;
-		vec.x = mesh->mVertices[i].x;
-		vec.y = mesh->mVertices[i].y;
-		vec.z = mesh->mVertices[i].z;
-		vertex.Position = vec;
-
-		vec.x = mesh->mNormals[i].x;
-		vec.y = mesh->mNormals[i].y;
-		vec.z = mesh->mNormals[i].z;
-		vertex.Normal = vec;
+		vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		if (mesh->HasNormals())
+			vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		else
+			vertex.Normal = glm::vec3(0.f);
 
 		if (mesh->mTextureCoords[0]) // does the mesh contain texture coords?
-		{
-			glm::vec2 texVec;
-			texVec.x = mesh->mTextureCoords[0][i].x;
-			texVec.y = mesh->mTextureCoords[0][i].y;
-			vertex.TexCoord = texVec;
-		}
+			vertex.TexCoord = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 		else
-		{
 			vertex.TexCoord = glm::vec2(0.f, 0.f);
-		}
-		vertices.push_back(vertex);
 	}
 
-	// process indices
+	// process indices; aiProcess_Triangulate leaves (almost) only triangles
+	vector<unsigned int>& indices = newMesh.indices;
+	indices.reserve(mesh->mNumFaces * 3);
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
-		for (unsigned int j = 0; j < face.mNumIndices; j++)
-		{
-			indices.push_back(face.mIndices[j]);
-		}
+		const aiFace& face = mesh->mFaces[i];
+		indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
 	}
 
+	// e.g. OBJ files without "vn" lines
+	if (!mesh->HasNormals() && !vertices.empty())
+		GenerateNormals(indices.data(), indices.size(), &vertices[0].Position.x, (unsigned int)vertices.size(), sizeof(Vertex),
+			&vertices[0].Normal.x, sizeof(Vertex), true);
+
 	// process material
 	if (mesh->mMaterialIndex >= 0)
 	{
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
 		// load diffuse maps
-		LoadMaterialTextures(newMesh, material, aiTextureType_DIFFUSE, "texture_diffuse", directory);
+		LoadMaterialTextures(newMesh, material, aiTextureType_DIFFUSE, "texture_diffuse", directory, upload);
 		// load specular maps
-		LoadMaterialTextures(newMesh, material, aiTextureType_SPECULAR, "texture_specular", directory);
+		LoadMaterialTextures(newMesh, material, aiTextureType_SPECULAR, "texture_specular", directory, upload);
 		// load normal maps
-		LoadMaterialTextures(newMesh, material, aiTextureType_HEIGHT, "texture_normal", directory);
+		LoadMaterialTextures(newMesh, material, aiTextureType_HEIGHT, "texture_normal", directory, upload);
 	}
 
-	newMesh.vertices = vertices;
-	newMesh.indices = indices;
 	return newMesh;
 }
 
-static void ProcessNode(vector<Mesh>& meshes, aiNode* node, const aiScene* scene, const string directory)
+static void ProcessNode(vector<Mesh>& meshes, aiNode* node, const aiScene* scene, const string directory, bool upload)
 {
 	// process all the node's meshes (if any)
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(ProcessMesh(mesh, scene, directory));
+		meshes.push_back(ProcessMesh(mesh, scene, directory, upload));
 	}
 	// then do the same for each of its children
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		ProcessNode(meshes, node->mChildren[i], scene, directory);
+		ProcessNode(meshes, node->mChildren[i], scene, directory, upload);
 	}
 }
 
-static vector<Mesh> LoadModelMeshes(string path)
+vector<Mesh> AB::LoadModelMeshes(const string& path, bool upload)
 {
+	auto start = chrono::steady_clock::now();
+
+	// repeat loads read the binary cache written after the first import
 	vector<Mesh> meshes;
+	if (LoadMeshCache(path, meshes, upload))
+	{
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << "Model " << path << " loaded from mesh cache in " << ms << "ms" << endl;
+		return meshes;
+	}
+
 	Assimp::Importer import;
 	// if model doesn't entirely consist of tri's, transform them to tri's first
 	const aiScene * scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -138,7 +135,29 @@ static vector<Mesh> LoadModelMeshes(string path)
 	}
 
 	// Process all nodes and add them as child game objects
-	ProcessNode(meshes, scene->mRootNode, scene, path.substr(0, path.find_last_of('/')));
+	ProcessNode(meshes, scene->mRootNode, scene, path.substr(0, path.find_last_of('/')), upload);
+
+	// optimize, simplify and cluster once here so the cache and every later load get the optimized order, LODs and
+	// meshlets for free
+	float missesBefore = 0.f, missesAfter = 0.f;
+	size_t triangles = 0;
+	for (Mesh& mesh : meshes)
+	{
+		float meshTriangles = (float)(mesh.indices.size() / 3);
+		missesBefore += ComputeACMR(mesh.indices, (unsigned int)mesh.vertices.size()) * meshTriangles;
+		OptimizeMesh(mesh.vertices, mesh.indices);
+		missesAfter += ComputeACMR(mesh.indices, (unsigned int)mesh.vertices.size()) * meshTriangles;
+		triangles += mesh.indices.size() / 3;
+		mesh.GenerateLODs();
+		mesh.GenerateMeshlets();
+	}
+	SaveMeshCache(path, meshes);
+
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "Model " << path << " imported in " << ms << "ms";
+	if (triangles)
+		cout << " (ACMR " << missesBefore / triangles << " -> " << missesAfter / triangles << ")";
+	cout << endl;
 	return meshes;
 }
 
@@ -146,7 +165,21 @@ static vector<Mesh> LoadModelMeshes(string path)
 /////////////////////////////////////////////////////
 //    ------- GameObject definitions ---------     //
 /////////////////////////////////////////////////////
-void GameObject::SetParams(vector<Mesh> meshes, string name, Transform localT, GameObject* parent)
+// wraps meshes so GameObjects can share them, creating GPU buffers for any that don't have them yet
+static vector<shared_ptr<Mesh>> ShareMeshes(vector<Mesh>& meshes)
+{
+	vector<shared_ptr<Mesh>> shared;
+	shared.reserve(meshes.size());
+	for (Mesh& m : meshes)
+	{
+		shared.push_back(make_shared<Mesh>(std::move(m)));
+		if (!shared.back()->GetVAO())
+			shared.back()->RefreshBuffers();
+	}
+	return shared;
+}
+
+void GameObject::SetParams(const vector<shared_ptr<Mesh>>& meshes, string name, Transform localT, GameObject* parent)
 {
 	this->parent = parent;
 	if (parent)
@@ -155,10 +188,6 @@ void GameObject::SetParams(vector<Mesh> meshes, string name, Transform localT, G
 	}
 
 	this->meshes = meshes;
-	for (Mesh& m : this->meshes)
-	{
-		m.RefreshBuffers();
-	}
 	this->name = name;
 	SetLocalTM(localT);
 }
@@ -190,12 +219,17 @@ void GameObject::operator=(const GameObject& other)
 }
 
 GameObject::GameObject(vector<Mesh> meshes, string name, Transform localT, GameObject* parent)
+{
+	SetParams(ShareMeshes(meshes), name, localT, parent);
+}
+GameObject::GameObject(vector<shared_ptr<Mesh>> meshes, string name, Transform localT, GameObject* parent)
 {
 	SetParams(meshes, name, localT, parent);
 }
 GameObject::GameObject(const char* path, string name, Transform localT, GameObject* parent)
 {
-	SetParams(LoadModelMeshes(path), name, localT, parent);
+	vector<Mesh> meshes = LoadModelMeshes(path);
+	SetParams(ShareMeshes(meshes), name, localT, parent);
 }
 
 GameObject::~GameObject()
@@ -221,17 +255,18 @@ void GameObject::Draw(Shader& shader, int drawMode)
 {
 	glm::mat4x4 world = worldTm.GetMatrix();
 
-	shader.SetMatrix4x4("world", world);
+	const StandardUniforms& uniforms = shader.standard;
+	shader.SetMatrix4x4(uniforms.world, world);
 
-	shader.SetVector3("albedoColor", material.albedo);
-	shader.SetFloat("metallic", material.metallic);
-	shader.SetFloat("roughness", material.roughness);
-	shader.SetVector3("emissive", material.emissive);
+	shader.SetVector3(uniforms.albedoColor, material.albedo);
+	shader.SetFloat(uniforms.metallic, material.metallic);
+	shader.SetFloat(uniforms.roughness, material.roughness);
+	shader.SetVector3(uniforms.emissive, material.emissive);
 
 	// draw all meshes on this object
-	for (Mesh& mesh : meshes)
+	for (auto& mesh : meshes)
 	{
-		mesh.Draw(shader, drawMode);
+		mesh->Draw(shader, drawMode);
 	}
 }
 
@@ -259,6 +294,7 @@ void GameObject::SetLocalTM(Transform newT)
 {
 	localTm = newT;
 	worldTm = parent ? parent->worldTm.GetMatrix() * localTm.GetMatrix() : localTm;
+	UpdateWorldBounds();
 
 	// tell children to update their world transforms accordingly
 	for (auto& child : children)
@@ -271,6 +307,30 @@ void GameObject::SetLocalTM(glm::vec3 translation, glm::quat rotation, glm::vec3
 	SetLocalTM(Transform(translation, rotation, scale));
 }
 
+void GameObject::UpdateWorldBounds()
+{
+	glm::mat4 world = worldTm.GetMatrix();
+	worldBounds = AABB();
+	for (auto& mesh : meshes)
+		worldBounds.Add(mesh->bounds.Transform(world));
+}
+
+void GameObject::ReplaceMesh(const shared_ptr<Mesh>& mesh, const vector<shared_ptr<Mesh>>& replacement)
+{
+	auto it = find(meshes.begin(), meshes.end(), mesh);
+	if (it == meshes.end())
+		return;
+
+	it = meshes.erase(it);
+	meshes.insert(it, replacement.begin(), replacement.end());
+	UpdateWorldBounds();
+}
+
+const AABB& GameObject::GetWorldBounds() const
+{
+	return worldBounds;
+}
+
 Material& GameObject::GetMaterial()
 {
 	return material;
@@ -311,7 +371,7 @@ GameObject* GameObject::GetParent()
 	return parent;
 }
 
-vector<Mesh>& GameObject::GetMeshes()
+vector<shared_ptr<Mesh>>& GameObject::GetMeshes()
 {
 	return meshes;
 }
@@ -6,9 +6,15 @@
 #include "Shader.h"
 
 #include <string>
+#include <memory>
 
 namespace AB
 {
+	// Imports the meshes of a model file (through its mesh cache if it has one, see MeshCache.h).
+	// Without upload nothing touches GL, so it can run on any thread: the meshes have no GPU buffers yet
+	// and their textures are listed with id 0 instead of being loaded.
+	std::vector<Mesh> LoadModelMeshes(const std::string& path, bool upload = true);
+
 	class GameObject
 	{
 	public:
@@ -21,6 +27,8 @@ namespace AB
 
 		GameObject(const char* path, std::string name = "Game Object", Transform tm = Transform(), GameObject* parent = nullptr);
 		GameObject(std::vector<Mesh> meshes, std::string name = "Game Object", Transform tm = Transform(), GameObject* parent = nullptr);
+		// shares the given meshes instead of copying them; copies of a GameObject share their meshes the same way
+		GameObject(std::vector<std::shared_ptr<Mesh>> meshes, std::string name = "Game Object", Transform tm = Transform(), GameObject* parent = nullptr);
 		~GameObject();
 
 		void Draw(Shader& shader, int drawMode = 0x0004);
@@ -33,8 +41,13 @@ namespace AB
 		void SetLocalTM(Transform newT);
 		void SetLocalTM(glm::vec3 translation, glm::quat rotation, glm::vec3 scale);
 
+		// world-space bounds of all meshes, kept up to date with the world transform
+		const AABB& GetWorldBounds() const;
+
 		Material& GetMaterial();
-		std::vector<Mesh>& GetMeshes();
+		std::vector<std::shared_ptr<Mesh>>& GetMeshes();
+		// puts replacement in place of mesh, if this object has it
+		void ReplaceMesh(const std::shared_ptr<Mesh>& mesh, const std::vector<std::shared_ptr<Mesh>>& replacement);
 
 		std::vector<GameObject*> GetChildren();
 		std::vector<GameObject*> GetDescendants();
@@ -45,10 +58,12 @@ namespace AB
 
 	private:
 
-		void SetParams(std::vector<Mesh> meshes, std::string name, Transform localT, GameObject* parent);
+		void UpdateWorldBounds();
+		void SetParams(const std::vector<std::shared_ptr<Mesh>>& meshes, std::string name, Transform localT, GameObject* parent);
 
-		std::vector<Mesh> meshes;
+		std::vector<std::shared_ptr<Mesh>> meshes;
 		Transform localTm, worldTm;
+		AABB worldBounds;
 		Material material;
 
 		std::vector<GameObject*> children;
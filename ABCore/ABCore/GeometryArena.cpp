@@ -0,0 +1,237 @@
+#include "GeometryArena.h"
+#include "Mesh.h"
+#include "RenderState.h"
+
+#include <GL/glew.h>
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+using namespace AB;
+
+GeometryArena* GeometryArena::instances[VERTEX_FORMAT_COUNT];
+
+// starting sizes; 64k vertices is 2MB as floats
+#define INITIAL_VERTEX_CAPACITY (1 << 16)
+#define INITIAL_INDEX_CAPACITY (3 << 16)
+#define INITIAL_INSTANCE_CAPACITY (1 << 10)
+
+void GeometryArena::Init()
+{
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	vertexCapacity = INITIAL_VERTEX_CAPACITY;
+	indexCapacity = INITIAL_INDEX_CAPACITY;
+
+	// uploads go through the copy targets so they never touch whichever VAO is bound
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * GetVertexSize(), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * GetIndexSize(), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (!instanceCapacity)
+		instanceCapacity = INITIAL_INSTANCE_CAPACITY;
+	CreateInstanceBuffer();
+
+	glGenVertexArrays(1, &VAO);
+	SetupVertexArray();
+}
+
+unsigned int GeometryArena::GetVertexSize() const
+{
+	return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+unsigned int GeometryArena::GetIndexSize() const
+{
+	return format == VERTEX_FORMAT_PACKED ? sizeof(unsigned short) : sizeof(unsigned int);
+}
+
+unsigned int GeometryArena::GetIndexType() const
+{
+	return format == VERTEX_FORMAT_PACKED ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void GeometryArena::Grow(unsigned int& buffer, unsigned int usedBytes, unsigned int newCapacity)
+{
+	unsigned int newBuffer;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+
+	if (usedBytes)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &buffer);
+	buffer = newBuffer;
+}
+
+void GeometryArena::SetupVertexArray()
+{
+	RenderState& state = RenderState::Get();
+	state.BindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	if (format == VERTEX_FORMAT_PACKED)
+	{
+		// vPos in 0..1 of the bounds, vNormal.xy octahedral (z reads 0), vTexCoord from halves
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoord));
+	}
+	else
+	{
+		// vPos, vNormal, vTexCoord
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoord));
+	}
+
+	// vInstance: instance i of a draw with base instance b reads element b + i
+	glBindBuffer(GL_ARRAY_BUFFER, instanceSource ? instanceSource : instanceVBO);
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+	glVertexAttribDivisor(3, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// unbind so later GL_ELEMENT_ARRAY_BUFFER binds can't end up in this VAO
+	state.BindVertexArray(0);
+}
+
+void GeometryArena::Reserve(unsigned int usedVertices, unsigned int usedIndices)
+{
+	bool grew = false;
+	if (vertexRanges.GetEnd() > vertexCapacity)
+	{
+		while (vertexRanges.GetEnd() > vertexCapacity)
+			vertexCapacity *= 2;
+		Grow(VBO, usedVertices * GetVertexSize(), vertexCapacity * GetVertexSize());
+		grew = true;
+	}
+	if (indexRanges.GetEnd() > indexCapacity)
+	{
+		while (indexRanges.GetEnd() > indexCapacity)
+			indexCapacity *= 2;
+		Grow(EBO, usedIndices * GetIndexSize(), indexCapacity * GetIndexSize());
+		grew = true;
+	}
+	if (grew)
+		SetupVertexArray();
+}
+
+GeometryRange GeometryArena::Allocate(const void* vertices, unsigned int newVertexCount, const void* indices, unsigned int newIndexCount)
+{
+	if (!VAO)
+		Init();
+
+	unsigned int usedVertices = vertexRanges.GetEnd(), usedIndices = indexRanges.GetEnd();
+	GeometryRange range;
+	range.firstIndex = indexRanges.Allocate(newIndexCount);
+	range.indexCount = newIndexCount;
+	range.baseVertex = (int)vertexRanges.Allocate(newVertexCount);
+	range.vertexCount = newVertexCount;
+	Reserve(usedVertices, usedIndices);
+
+	Update(range, vertices, indices);
+	return range;
+}
+
+GeometryRange GeometryArena::AllocateIndices(const GeometryRange& vertexRange, const void* indices, unsigned int newIndexCount)
+{
+	if (!VAO)
+		Init();
+
+	unsigned int usedIndices = indexRanges.GetEnd();
+	GeometryRange range = vertexRange;
+	range.firstIndex = indexRanges.Allocate(newIndexCount);
+	range.indexCount = newIndexCount;
+	Reserve(vertexRanges.GetEnd(), usedIndices);
+
+	Update(range, nullptr, indices);
+	return range;
+}
+
+void GeometryArena::Free(const GeometryRange& range)
+{
+	vertexRanges.Free((unsigned int)range.baseVertex, range.vertexCount);
+	indexRanges.Free(range.firstIndex, range.indexCount);
+}
+
+void GeometryArena::FreeIndices(const GeometryRange& range)
+{
+	indexRanges.Free(range.firstIndex, range.indexCount);
+}
+
+void GeometryArena::Update(const GeometryRange& range, const void* vertices, const void* indices)
+{
+	if (vertices)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, range.baseVertex * GetVertexSize(), range.vertexCount * GetVertexSize(), vertices);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * GetIndexSize(), range.indexCount * GetIndexSize(), indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::ReserveInstances(unsigned int count)
+{
+	if (instanceVBO && count <= instanceCapacity)
+		return;
+
+	if (!instanceCapacity)
+		instanceCapacity = INITIAL_INSTANCE_CAPACITY;
+	while (count > instanceCapacity)
+		instanceCapacity *= 2;
+
+	// an arena nothing has been allocated in yet creates the buffer when it is
+	if (!VAO)
+		return;
+
+	CreateInstanceBuffer();
+	if (!instanceSource)
+		SetupVertexArray();
+}
+
+void GeometryArena::CreateInstanceBuffer()
+{
+	// identity buffer: element i holds i
+	vector<unsigned int> indices(instanceCapacity);
+	for (unsigned int i = 0; i < instanceCapacity; i++)
+		indices[i] = i;
+
+	if (!instanceVBO)
+		glGenBuffers(1, &instanceVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, instanceVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, instanceCapacity * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::SetInstanceIndexBuffer(unsigned int buffer)
+{
+	if (buffer == instanceSource)
+		return;
+
+	instanceSource = buffer;
+	if (VAO)
+		SetupVertexArray();
+}
+
+unsigned int GeometryArena::GetVAO()
+{
+	if (!VAO)
+		Init();
+	return VAO;
+}
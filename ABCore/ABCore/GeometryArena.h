@@ -0,0 +1,100 @@
+#pragma once
+
+#include "VertexFormat.h"
+#include "RangeAllocator.h"
+
+namespace AB
+{
+
+	// Where a mesh's geometry lives in the arena's buffers
+	struct GeometryRange
+	{
+		unsigned int firstIndex = 0;
+		unsigned int indexCount = 0;
+		int baseVertex = 0;
+		unsigned int vertexCount = 0;
+	};
+
+	// Layout GL expects in GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+	struct DrawCommand
+	{
+		unsigned int indexCount;
+		unsigned int instanceCount;
+		unsigned int firstIndex;
+		int baseVertex;
+		unsigned int baseInstance;
+	};
+
+	// Singleton per VertexFormat holding the geometry of every static mesh in that format in one vertex buffer and
+	// one index buffer behind a single VAO, so meshes can be drawn without VAO changes and many at once with
+	// glMultiDrawElementsIndirect. Freed ranges are reused by later allocations that fit in them; the buffers double
+	// in size when nothing does.
+	//
+	// The VAO also has a per-instance (divisor 1) uint at location 3 that reads base instance + gl_InstanceID,
+	// which instanced shaders use to index their per-instance data. By default it reads an identity buffer;
+	// occlusion culling points it at its list of visible instances instead.
+	class GeometryArena
+	{
+	public:
+
+		static GeometryArena& Get(VertexFormat format = VERTEX_FORMAT_FLOAT)
+		{
+			if (!instances[format])
+				instances[format] = new GeometryArena(format);
+			return *instances[format];
+		}
+
+		GeometryArena(GeometryArena const&) = delete;
+		void operator=(GeometryArena const&) = delete;
+
+		// copies the geometry into the arena; vertices and indices must already be in its format
+		// (GetVertexSize and GetIndexSize bytes each), and indices are relative to the mesh's own vertices
+		GeometryRange Allocate(const void* vertices, unsigned int vertexCount, const void* indices, unsigned int indexCount);
+		// adds indices for the vertices of a range returned by Allocate, e.g. a LOD of the same mesh
+		GeometryRange AllocateIndices(const GeometryRange& vertexRange, const void* indices, unsigned int indexCount);
+		// overwrites a range returned by Allocate with geometry of the same size; null vertices only overwrites the indices
+		void Update(const GeometryRange& range, const void* vertices, const void* indices);
+		// gives back the vertices and indices of a range returned by Allocate, or only the indices of one returned
+		// by AllocateIndices
+		void Free(const GeometryRange& range);
+		void FreeIndices(const GeometryRange& range);
+
+		// makes sure instance indices up to count can be read at location 3
+		void ReserveInstances(unsigned int count);
+		// reads the instance indices at location 3 from buffer instead; 0 goes back to the identity buffer
+		void SetInstanceIndexBuffer(unsigned int buffer);
+
+		unsigned int GetVAO();
+
+		VertexFormat GetFormat() const { return format; }
+		unsigned int GetVertexSize() const;
+		unsigned int GetIndexSize() const;
+		// GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+		unsigned int GetIndexType() const;
+
+		// one past the last vertex and index in use
+		unsigned int GetVertexCount() const { return vertexRanges.GetEnd(); }
+		unsigned int GetIndexCount() const { return indexRanges.GetEnd(); }
+
+	private:
+
+		static GeometryArena* instances[VERTEX_FORMAT_COUNT];
+
+		GeometryArena(VertexFormat format) : format(format) {};
+
+		void Init();
+		// grows buffer to newCapacity bytes, keeping the first usedBytes
+		void Grow(unsigned int& buffer, unsigned int usedBytes, unsigned int newCapacity);
+		// makes room for everything the allocators have handed out, given what was in use before
+		void Reserve(unsigned int usedVertices, unsigned int usedIndices);
+		void SetupVertexArray();
+		void CreateInstanceBuffer();
+
+		VertexFormat format;
+		unsigned int VAO = 0, VBO = 0, EBO = 0, instanceVBO = 0;
+		// the buffer location 3 reads from: instanceVBO or an external index list
+		unsigned int instanceSource = 0;
+		RangeAllocator vertexRanges, indexRanges;
+		unsigned int vertexCapacity = 0, indexCapacity = 0, instanceCapacity = 0;
+	};
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace AB
+{
+	// A read-only view of a whole file, unmapped when it goes out of scope. data is null if the file couldn't be
+	// opened or is empty. Only depends on the OS, so code outside ABCore can compile it on its own.
+	class MappedFile
+	{
+	public:
+
+		MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(MappedFile const&) = delete;
+		void operator=(MappedFile const&) = delete;
+
+		const char* data = nullptr;
+		size_t size = 0;
+
+	private:
+
+		// Windows file and mapping handles, kept as void* so this header doesn't need windows.h
+		void* file = nullptr;
+		void* mapping = nullptr;
+	};
+}
@@ -1,12 +1,22 @@
 #include "Mesh.h"
+#include "RenderState.h"
+#include "GeometryArena.h"
+#include "TextureCache.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
 
 #include <GL/glew.h>
-#include <stb_image.h>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 using namespace AB;
 
+// meshes this small aren't worth simplifying any further
+#define MIN_LOD_TRIANGLES 64
+// meshes smaller than this are culled as a whole; bigger ones, like terrain, per meshlet
+#define MIN_MESHLET_MESH_TRIANGLES 8192
+
 Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
 {
     this->type = MESH_TRI;
@@ -20,20 +30,23 @@ Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture
 Mesh::Mesh(float radius)
 {
     this->type = MESH_SPHERE;
-    this->EBO = this->VBO = this->VAO = 0;
+    this->VAO = 0;
     this->radius = radius;
 }
 
 Mesh::~Mesh()
 {
-    /*glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteVertexArrays(1, &VAO);
+    // the arena ranges go back once no copy of this mesh holds the allocation anymore,
+    // and textures are freed by the TextureCache once no mesh holds them.
+}
 
-    for (auto& tex : textures)
-    {
-        glDeleteTextures(1, &tex.id);
-    }*/
+MeshAllocation::~MeshAllocation()
+{
+    GeometryArena& arena = GeometryArena::Get(format);
+    for (const GeometryRange& lod : lods)
+        arena.FreeIndices(lod);
+    arena.Free(geometry);
+    MeshletArena::Get().Free(firstMeshlet, meshletCount);
 }
 
 void Mesh::RefreshBuffers()
@@ -41,120 +54,207 @@ void Mesh::RefreshBuffers()
     if (vertices.empty()) return;
 
     type = MESH_TRI;
+    bounds = AABB::FromVertices(vertices);
 
-    if (VAO)
-        glDeleteVertexArrays(1, &VAO);
-    if (VBO)
-        glDeleteBuffers(1, &VBO);
-    if (EBO)
-        glDeleteBuffers(1, &EBO);
-
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    Upload(vertices.data(), (unsigned int)vertices.size(), indices.data(), (unsigned int)indices.size());
+}
 
-    glBindVertexArray(VAO);
+void Mesh::Upload(const Vertex* newVertices, unsigned int vertexCount, const unsigned int* newIndices, unsigned int indexCount)
+{
+    VertexFormat format = ResolveVertexFormat(vertexFormat, vertexCount);
+    GeometryArena& arena = GeometryArena::Get(format);
 
-    // copy vertices into VBO
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    const void* arenaVertices = newVertices;
+    const void* arenaIndices = newIndices;
+    vector<PackedVertex> packedVertices;
+    vector<unsigned short> packedIndices;
+    if (format == VERTEX_FORMAT_PACKED)
+    {
+        PackVertices(newVertices, vertexCount, bounds, packedVertices);
+        PackIndices(newIndices, indexCount, packedIndices);
+        arenaVertices = packedVertices.data();
+        arenaIndices = packedIndices.data();
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // geometry of the same size and format is overwritten in place, unless a copy of this mesh still draws it.
+    // Anything else gets new ranges, and the old ones go back to the arenas once no copy holds them.
+    bool inPlace = allocation && allocation.use_count() == 1 && format == allocation->format &&
+        allocation->geometry.vertexCount == vertexCount && allocation->geometry.indexCount == indexCount;
+    if (inPlace)
+        arena.Update(geometry, arenaVertices, arenaIndices);
+    else
+    {
+        allocation.reset();
+        allocation = make_shared<MeshAllocation>();
+        allocation->format = format;
+        allocation->geometry = arena.Allocate(arenaVertices, vertexCount, arenaIndices, indexCount);
+        geometry = allocation->geometry;
+    }
 
-    // vPos
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // the LODs share the vertices, so they only add indices
+    for (size_t i = lods.size(); i < allocation->lods.size(); i++)
+        arena.FreeIndices(allocation->lods[i]);
+    allocation->lods.resize(lods.size());
+    for (size_t i = 0; i < lods.size(); i++)
+    {
+        MeshLOD& lod = lods[i];
+        unsigned int lodIndexCount = (unsigned int)lod.indices.size();
+        const void* lodIndices = lod.indices.data();
+        if (format == VERTEX_FORMAT_PACKED)
+        {
+            PackIndices(lod.indices.data(), lodIndexCount, packedIndices);
+            lodIndices = packedIndices.data();
+        }
 
-    // vNormal
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        GeometryRange& range = allocation->lods[i];
+        if (inPlace && range.indexCount == lodIndexCount)
+            arena.Update(range, nullptr, lodIndices);
+        else
+        {
+            arena.FreeIndices(range);
+            range = arena.AllocateIndices(geometry, lodIndices, lodIndexCount);
+        }
+        lod.geometry = range;
+    }
 
-    // vTexCoord
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoord));
+    // the arena's meshlets point straight at the triangles in the GeometryArena
+    MeshletArena& meshletArena = MeshletArena::Get();
+    vector<Meshlet> arenaMeshlets = meshlets;
+    for (Meshlet& meshlet : arenaMeshlets)
+    {
+        meshlet.firstIndex += geometry.firstIndex;
+        meshlet.baseVertex = geometry.baseVertex;
+    }
+    if (inPlace && allocation->meshletCount == arenaMeshlets.size())
+        meshletArena.Update(allocation->firstMeshlet, arenaMeshlets.data(), allocation->meshletCount);
+    else
+    {
+        meshletArena.Free(allocation->firstMeshlet, allocation->meshletCount);
+        allocation->firstMeshlet = meshletArena.Allocate(arenaMeshlets.data(), (unsigned int)arenaMeshlets.size());
+        allocation->meshletCount = (unsigned int)arenaMeshlets.size();
+    }
+    firstMeshlet = allocation->firstMeshlet;
+    meshletCount = allocation->meshletCount;
 
-    glBindVertexArray(0);
+    uploadedFormat = format;
+    positionDecode = AB::GetPositionDecode(format, bounds);
+    VAO = arena.GetVAO();
 }
 
-Texture& Mesh::AddTexture(string typeName, const char* path, const string& directory)
+void Mesh::SetGeometry(const Vertex* newVertices, unsigned int vertexCount, const unsigned int* newIndices, unsigned int indexCount, const AABB& newBounds)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    if (!vertexCount) return;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    type = MESH_TRI;
+    bounds = newBounds;
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format = 0;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-
-        Texture texture;
-        texture.id = textureID;
-        texture.type = typeName;
-        texture.path = path;
-        textures.push_back(texture);
-    }
-    else
+    // the CPU copies are still needed for raycasts
+    vertices.assign(newVertices, newVertices + vertexCount);
+    indices.assign(newIndices, newIndices + indexCount);
+
+    Upload(newVertices, vertexCount, newIndices, indexCount);
+}
+
+void Mesh::GenerateLODs(unsigned int maxLODs)
+{
+    lods.clear();
+    if (vertices.empty())
+        return;
+
+    float error = 0.f;
+    unsigned int indexCount = (unsigned int)indices.size();
+    while (lods.size() < maxLODs && indexCount / 3 > MIN_LOD_TRIANGLES)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        // every LOD is simplified from the full mesh, so its error is measured against the full mesh
+        MeshLOD lod;
+        float lodError;
+        lod.indices = SimplifyMesh(indices, &vertices[0].Position.x, (unsigned int)vertices.size(), sizeof(Vertex), indexCount / 6 * 3, FLT_MAX, &lodError);
+
+        // stop once it's stuck, e.g. on borders it may not move
+        if (lod.indices.empty() || lod.indices.size() > indexCount * 3 / 4)
+            break;
+
+        OptimizeVertexCache(lod.indices, (unsigned int)vertices.size());
+        error = max(error, lodError);
+        lod.error = error;
+        indexCount = (unsigned int)lod.indices.size();
+        lods.push_back(move(lod));
     }
+}
+
+void Mesh::GenerateMeshlets()
+{
+    meshlets.clear();
+    if (indices.size() / 3 >= MIN_MESHLET_MESH_TRIANGLES)
+        meshlets = BuildMeshlets(vertices, indices);
+}
 
-    return textures.back();
+unsigned int Mesh::SelectLOD(float pixelsPerUnit, float maxPixelError) const
+{
+    unsigned int lod = 0;
+    while (lod < lods.size() && lods[lod].error * pixelsPerUnit <= maxPixelError)
+        lod++;
+    return lod;
 }
 
-void Mesh::Draw(Shader& shader, int drawMode)
+bool Mesh::AddTexture(string typeName, const char* path, const string& directory)
+{
+    Texture texture = TextureCache::Get().Load(typeName, path, directory);
+    if (!texture.id)
+        return false;
+
+    textures.push_back(texture);
+    return true;
+}
+
+void Mesh::BindTextures(Shader& shader)
 {
     unsigned int diffuseNr = 0;
     unsigned int specularNr = 0;
 
-    shader.SetBool("useDiffuseTex", false);
-    if (!textures.empty())
+    RenderState& state = RenderState::Get();
+    const StandardUniforms& uniforms = shader.standard;
+    bool useDiffuseTex = false;
+    for (unsigned int i = 0; i < textures.size(); i++)
     {
-        for (unsigned int i = 0; i < textures.size(); i++)
+        // point the N-th sampler of this texture's type (texture_diffuse[N]) at this texture unit
+        UniformHandle sampler;
+        const string& type = textures[i].type;
+        if (type == "texture_diffuse")
+        {
+            if (diffuseNr < StandardUniforms::MAX_TEXTURES)
+                sampler = uniforms.diffuseTextures[diffuseNr];
+            diffuseNr++;
+            useDiffuseTex = true;
+        }
+        else if (type == "texture_specular")
         {
-            glActiveTexture(GL_TEXTURE0 + i); // activate proper texture unit before binding
-
-            // retreive texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-            {
-                number = "[" + to_string(diffuseNr++) + "]";
-                shader.SetBool("useDiffuseTex", true);
-            }
-            else if (name == "texture_specular")
-                number = to_string(specularNr++);
-
-            shader.SetInt(("material." + name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if (specularNr < StandardUniforms::MAX_TEXTURES)
+                sampler = uniforms.specularTextures[specularNr];
+            specularNr++;
         }
-        glActiveTexture(GL_TEXTURE0);
+
+        shader.SetInt(sampler, i);
+        state.BindTexture(i, textures[i].id);
     }
+    shader.SetBool(uniforms.useDiffuseTex, useDiffuseTex);
+}
+
+void Mesh::Draw(Shader& shader, int drawMode, int instanceCount, unsigned int baseInstance, unsigned int lod)
+{
+    BindTextures(shader);
+
+    const StandardUniforms& uniforms = shader.standard;
+    shader.SetVector4(uniforms.positionOffset, positionDecode.offset);
+    shader.SetVector4(uniforms.positionScale, positionDecode.scale);
 
-    // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // draw mesh. The VAO and textures stay bound, so a following draw of the same mesh binds nothing.
+    RenderState::Get().BindVertexArray(VAO);
+    const GeometryArena& arena = GeometryArena::Get(uploadedFormat);
+    const GeometryRange& range = GetGeometry(lod);
+    const void* firstIndex = (const void*)(size_t)(range.firstIndex * arena.GetIndexSize());
+    if (instanceCount == 1 && baseInstance == 0)
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, arena.GetIndexType(), firstIndex, range.baseVertex);
+    else
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, arena.GetIndexType(), firstIndex, instanceCount, range.baseVertex, baseInstance);
 }
\ No newline at end of file
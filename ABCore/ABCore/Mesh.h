@@ -4,7 +4,11 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include "Shader.h"
+#include "GeometryArena.h"
+#include "Culling.h"
+#include "Meshlet.h"
 
 namespace AB
 {
@@ -15,11 +19,38 @@ namespace AB
 		glm::vec2 TexCoord;
 	};
 
+	struct TextureResource;
+
 	struct Texture
 	{
 		unsigned int id;
 		std::string type;
 		std::string path;
+		// keeps the GL texture alive while anything uses it; null for textures the TextureCache doesn't own
+		std::shared_ptr<TextureResource> resource;
+	};
+
+	// A coarser version of a mesh: its own triangles over the same vertices
+	struct MeshLOD
+	{
+		std::vector<unsigned int> indices;
+		// how far, in the mesh's units, the simplified surface is from the full one
+		float error = 0.f;
+		GeometryRange geometry;
+	};
+
+	// What a mesh has allocated in the GeometryArena and the MeshletArena. Copies of a mesh share it, and the last
+	// one to let go of it gives the ranges back.
+	struct MeshAllocation
+	{
+		VertexFormat format = VERTEX_FORMAT_FLOAT;
+		GeometryRange geometry;
+		// the LODs' indices, over geometry's vertices
+		std::vector<GeometryRange> lods;
+		unsigned int firstMeshlet = 0;
+		unsigned int meshletCount = 0;
+
+		~MeshAllocation();
 	};
 
 	enum MeshType
@@ -36,21 +67,74 @@ namespace AB
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
 		std::vector<Texture> textures;
+		// LODs 1 and up, each with about half the triangles of the one before; LOD 0 is the mesh itself
+		std::vector<MeshLOD> lods;
+		// clusters of LOD 0's triangles, for meshes big enough to be culled in parts; empty for the rest
+		std::vector<Meshlet> meshlets;
 
-		Mesh() { VAO = VBO = EBO = radius = 0; };
+		Mesh() { VAO = 0; radius = 0; };
 		~Mesh();
+		Mesh(const Mesh&) = default;
+		Mesh(Mesh&&) = default;
+		Mesh& operator=(const Mesh&) = default;
+		Mesh& operator=(Mesh&&) = default;
 		Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
 		Mesh(float radius);
 
-		Texture& AddTexture(std::string typeName, const char* path, const std::string& directory);
+		// adds the image at directory/path through the TextureCache, so meshes sharing an image share one texture.
+		// Returns false, and adds nothing, if the image couldn't be loaded.
+		bool AddTexture(std::string typeName, const char* path, const std::string& directory);
+		// simplifies the mesh into up to maxLODs LODs, stopping early once it won't get any smaller.
+		// Call before the geometry is uploaded, which uploads the LODs with it.
+		void GenerateLODs(unsigned int maxLODs = 4);
+		// the coarsest LOD whose error covers at most maxPixelError pixels, where one unit of the mesh covers pixelsPerUnit
+		unsigned int SelectLOD(float pixelsPerUnit, float maxPixelError) const;
+		unsigned int GetLODCount() const { return 1 + (unsigned int)lods.size(); }
+		// splits large meshes into meshlets, reordering their triangles so each meshlet's are consecutive. Call after
+		// OptimizeMesh, and before the geometry is uploaded, which uploads the meshlets with it
+		void GenerateMeshlets();
+
+		// uploads vertices and indices (and the LODs' indices) into the GeometryArena, and the meshlets into the MeshletArena
 		void RefreshBuffers();
-		void Draw(Shader& shader, int drawMode = 0x0004);
+		// replaces the geometry with copies of the given arrays and uploads them straight from there,
+		// for geometry that is already laid out like the arena's (see MeshCache.h)
+		void SetGeometry(const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount, const AABB& bounds);
+		// points the shader's samplers at this mesh's textures and binds them
+		void BindTextures(Shader& shader);
+		// draws instanceCount instances of a LOD, numbered from baseInstance for the shader's per-instance data
+		void Draw(Shader& shader, int drawMode = 0x0004, int instanceCount = 1, unsigned int baseInstance = 0, unsigned int lod = 0);
+
+		// the arena's VAO, or 0 if the mesh has no geometry uploaded
+		unsigned int GetVAO() const { return VAO; }
+		const GeometryRange& GetGeometry(unsigned int lod = 0) const { return lod ? lods[lod - 1].geometry : geometry; }
+		// the format the geometry was uploaded in, and how shaders decode its positions
+		VertexFormat GetVertexFormat() const { return uploadedFormat; }
+		const PositionDecode& GetPositionDecode() const { return positionDecode; }
+		// where the meshlets are in the MeshletArena; a count of 0 if there are none uploaded
+		unsigned int GetFirstMeshlet() const { return firstMeshlet; }
+		unsigned int GetMeshletCount() const { return meshletCount; }
 
 		MeshType type = MESH_SPHERE;
 		float radius;
 
+		// local-space bounds of the vertices, updated by RefreshBuffers
+		AABB bounds;
+
+		// the format RefreshBuffers and SetGeometry upload in. VERTEX_FORMAT_PACKED needs shaders that include
+		// include/vertex_format.glsl, and meshes with too many vertices for it are uploaded as floats anyway.
+		VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+
 	private:
 
-		unsigned int VAO, VBO, EBO;
+		// puts the geometry in the arena of its format
+		void Upload(const Vertex* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount);
+
+		unsigned int VAO;
+		std::shared_ptr<MeshAllocation> allocation;
+		GeometryRange geometry;
+		VertexFormat uploadedFormat = VERTEX_FORMAT_FLOAT;
+		PositionDecode positionDecode;
+		unsigned int firstMeshlet = 0;
+		unsigned int meshletCount = 0;
 	};
 }
\ No newline at end of file
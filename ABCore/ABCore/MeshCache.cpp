@@ -0,0 +1,236 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+using namespace AB;
+
+static_assert(sizeof(MeshCacheHeader) == 64, "MeshCacheHeader must not have padding");
+static_assert(sizeof(MeshCacheEntry) == 64, "MeshCacheEntry must not have padding");
+static_assert(sizeof(Vertex) == 32, "the vertex block is read as Vertex[]");
+static_assert(sizeof(Meshlet) % 8 == 0, "the meshlet table must keep the blocks after it aligned");
+
+static bool GetSourceStamp(const string& path, unsigned long long& size, long long& time)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	size = (unsigned long long)st.st_size;
+	time = (long long)st.st_mtime;
+	return true;
+}
+
+static unsigned long long Align(unsigned long long offset)
+{
+	return (offset + 7) & ~7ull;
+}
+
+string AB::GetMeshCachePath(const string& modelPath)
+{
+	return modelPath + ".abmesh";
+}
+
+bool AB::LoadMeshCache(const string& modelPath, vector<Mesh>& meshes, bool upload)
+{
+	unsigned long long sourceSize;
+	long long sourceTime;
+	if (!GetSourceStamp(modelPath, sourceSize, sourceTime))
+		return false;
+
+	string cachePath = GetMeshCachePath(modelPath);
+	MappedFile file(cachePath);
+	if (!file.data || file.size < sizeof(MeshCacheHeader))
+		return false;
+
+	const MeshCacheHeader& header = *(const MeshCacheHeader*)file.data;
+	if (memcmp(header.magic, "ABMC", 4) != 0 || header.version != MESH_CACHE_VERSION)
+		return false;
+	if (header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+		return false;
+
+	const MeshCacheEntry* entries = (const MeshCacheEntry*)(file.data + sizeof(MeshCacheHeader));
+	const MeshCacheTexture* textures = (const MeshCacheTexture*)(entries + header.meshCount);
+	const MeshCacheLOD* lods = (const MeshCacheLOD*)(textures + header.textureCount);
+	const Meshlet* meshlets = (const Meshlet*)(lods + header.lodCount);
+	if ((const char*)(meshlets + header.meshletCount) > file.data + file.size || header.stringOffset > header.vertexOffset ||
+		header.vertexOffset > header.indexOffset || header.indexOffset > file.size)
+	{
+		cout << "ERROR: Mesh cache " << cachePath << " is truncated" << endl;
+		return false;
+	}
+
+	const char* strings = file.data + header.stringOffset;
+	const Vertex* vertices = (const Vertex*)(file.data + header.vertexOffset);
+	const unsigned int* indices = (const unsigned int*)(file.data + header.indexOffset);
+	size_t vertexBlockCount = (header.indexOffset - header.vertexOffset) / sizeof(Vertex);
+	size_t indexBlockCount = (file.size - header.indexOffset) / sizeof(unsigned int);
+	for (unsigned int i = 0; i < header.meshCount; i++)
+	{
+		const MeshCacheEntry& entry = entries[i];
+		if ((size_t)entry.firstVertex + entry.vertexCount > vertexBlockCount || (size_t)entry.firstIndex + entry.indexCount > indexBlockCount ||
+			entry.firstTexture + entry.textureCount > header.textureCount || entry.firstLod + entry.lodCount > header.lodCount ||
+			entry.firstMeshlet + entry.meshletCount > header.meshletCount)
+		{
+			cout << "ERROR: Mesh cache " << cachePath << " is corrupt" << endl;
+			meshes.clear();
+			return false;
+		}
+		for (unsigned int m = entry.firstMeshlet; m < entry.firstMeshlet + entry.meshletCount; m++)
+		{
+			if ((size_t)meshlets[m].firstIndex + meshlets[m].indexCount > entry.indexCount)
+			{
+				cout << "ERROR: Mesh cache " << cachePath << " is corrupt" << endl;
+				return false;
+			}
+		}
+	}
+	for (unsigned int i = 0; i < header.lodCount; i++)
+	{
+		if ((size_t)lods[i].firstIndex + lods[i].indexCount > indexBlockCount)
+		{
+			cout << "ERROR: Mesh cache " << cachePath << " is corrupt" << endl;
+			return false;
+		}
+	}
+
+	// same directory lookup as the importer uses for textures
+	string directory = modelPath.substr(0, modelPath.find_last_of('/'));
+
+	meshes.resize(header.meshCount);
+	for (unsigned int i = 0; i < header.meshCount; i++)
+	{
+		const MeshCacheEntry& entry = entries[i];
+		Mesh& mesh = meshes[i];
+
+		AABB bounds;
+		bounds.min = entry.boundsMin;
+		bounds.max = entry.boundsMax;
+
+		mesh.lods.resize(entry.lodCount);
+		for (unsigned int l = 0; l < entry.lodCount; l++)
+		{
+			const MeshCacheLOD& lod = lods[entry.firstLod + l];
+			mesh.lods[l].indices.assign(indices + lod.firstIndex, indices + lod.firstIndex + lod.indexCount);
+			mesh.lods[l].error = lod.error;
+		}
+		mesh.meshlets.assign(meshlets + entry.firstMeshlet, meshlets + entry.firstMeshlet + entry.meshletCount);
+
+		if (!upload)
+		{
+			for (unsigned int t = entry.firstTexture; t < entry.firstTexture + entry.textureCount; t++)
+				mesh.textures.push_back({ 0, strings + textures[t].type, strings + textures[t].path, nullptr });
+
+			mesh.vertices.assign(vertices + entry.firstVertex, vertices + entry.firstVertex + entry.vertexCount);
+			mesh.indices.assign(indices + entry.firstIndex, indices + entry.firstIndex + entry.indexCount);
+			mesh.bounds = bounds;
+			continue;
+		}
+
+		for (unsigned int t = entry.firstTexture; t < entry.firstTexture + entry.textureCount; t++)
+		{
+			if (!mesh.AddTexture(strings + textures[t].type, strings + textures[t].path, directory))
+				cout << "ERROR: Drawing mesh " << i << " of " << modelPath << " without its " << strings + textures[t].type << " " << strings + textures[t].path << endl;
+		}
+
+		mesh.SetGeometry(vertices + entry.firstVertex, entry.vertexCount, indices + entry.firstIndex, entry.indexCount, bounds);
+	}
+	return true;
+}
+
+void AB::SaveMeshCache(const string& modelPath, const vector<Mesh>& meshes)
+{
+	MeshCacheHeader header = {};
+	memcpy(header.magic, "ABMC", 4);
+	header.version = MESH_CACHE_VERSION;
+	if (!GetSourceStamp(modelPath, header.sourceSize, header.sourceTime))
+		return;
+
+	vector<MeshCacheEntry> entries;
+	vector<MeshCacheTexture> textures;
+	vector<MeshCacheLOD> lods;
+	vector<Meshlet> meshlets;
+	string strings;
+	unsigned int vertexCount = 0, indexCount = 0;
+	for (const Mesh& mesh : meshes)
+	{
+		MeshCacheEntry entry = {};
+		entry.firstVertex = vertexCount;
+		entry.vertexCount = (unsigned int)mesh.vertices.size();
+		entry.firstIndex = indexCount;
+		entry.indexCount = (unsigned int)mesh.indices.size();
+		entry.firstTexture = (unsigned int)textures.size();
+		entry.textureCount = (unsigned int)mesh.textures.size();
+		entry.firstLod = (unsigned int)lods.size();
+		entry.lodCount = (unsigned int)mesh.lods.size();
+		entry.firstMeshlet = (unsigned int)meshlets.size();
+		entry.meshletCount = (unsigned int)mesh.meshlets.size();
+		meshlets.insert(meshlets.end(), mesh.meshlets.begin(), mesh.meshlets.end());
+
+		AABB bounds = AABB::FromVertices(mesh.vertices);
+		entry.boundsMin = bounds.min;
+		entry.boundsMax = bounds.max;
+		entries.push_back(entry);
+
+		for (const Texture& texture : mesh.textures)
+		{
+			MeshCacheTexture cached;
+			cached.type = (unsigned int)strings.size();
+			strings.append(texture.type.c_str(), texture.type.size() + 1);
+			cached.path = (unsigned int)strings.size();
+			strings.append(texture.path.c_str(), texture.path.size() + 1);
+			textures.push_back(cached);
+		}
+
+		vertexCount += entry.vertexCount;
+		indexCount += entry.indexCount;
+
+		for (const MeshLOD& lod : mesh.lods)
+		{
+			MeshCacheLOD cached = {};
+			cached.firstIndex = indexCount;
+			cached.indexCount = (unsigned int)lod.indices.size();
+			cached.error = lod.error;
+			lods.push_back(cached);
+			indexCount += cached.indexCount;
+		}
+	}
+
+	header.meshCount = (unsigned int)entries.size();
+	header.textureCount = (unsigned int)textures.size();
+	header.lodCount = (unsigned int)lods.size();
+	header.meshletCount = (unsigned int)meshlets.size();
+	header.stringOffset = sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry) + textures.size() * sizeof(MeshCacheTexture) +
+		lods.size() * sizeof(MeshCacheLOD) + meshlets.size() * sizeof(Meshlet);
+	header.vertexOffset = Align(header.stringOffset + strings.size());
+	header.indexOffset = header.vertexOffset + (unsigned long long)vertexCount * sizeof(Vertex);
+
+	string cachePath = GetMeshCachePath(modelPath);
+	ofstream file(cachePath, ios::binary);
+	if (!file.is_open())
+	{
+		cout << "ERROR: Could not write mesh cache " << cachePath << endl;
+		return;
+	}
+
+	const char padding[8] = {};
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+	file.write((const char*)textures.data(), textures.size() * sizeof(MeshCacheTexture));
+	file.write((const char*)lods.data(), lods.size() * sizeof(MeshCacheLOD));
+	file.write((const char*)meshlets.data(), meshlets.size() * sizeof(Meshlet));
+	file.write(strings.data(), strings.size());
+	file.write(padding, header.vertexOffset - (header.stringOffset + strings.size()));
+	for (const Mesh& mesh : meshes)
+		file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+	for (const Mesh& mesh : meshes)
+	{
+		file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+		for (const MeshLOD& lod : mesh.lods)
+			file.write((const char*)lod.indices.data(), lod.indices.size() * sizeof(unsigned int));
+	}
+}
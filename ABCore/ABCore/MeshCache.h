@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Mesh.h"
+
+namespace AB
+{
+	// Binary copy of a model's meshes (.abmesh), written after the first import so later loads skip Assimp.
+	//
+	// Layout, every block 8-byte aligned:
+	//   MeshCacheHeader
+	//   MeshCacheEntry[meshCount]
+	//   MeshCacheTexture[textureCount]
+	//   MeshCacheLOD[lodCount]
+	//   Meshlet[meshletCount] (with firstIndex relative to the mesh's indices)
+	//   string block (null-terminated texture types and paths)
+	//   vertex block (Vertex[], every mesh's vertices back to back)
+	//   index block (unsigned int[], every mesh's indices followed by its LODs', back to back)
+	// The file is memory mapped on load and the blocks are handed to the GeometryArena as they are.
+
+	const unsigned int MESH_CACHE_VERSION = 4;
+
+	struct MeshCacheHeader
+	{
+		char magic[4];                  // "ABMC"
+		unsigned int version;
+		// size and modification time of the model file the cache was made from; a mismatch means it's stale
+		unsigned long long sourceSize;
+		long long sourceTime;
+		unsigned int meshCount;
+		unsigned int textureCount;
+		unsigned int lodCount;
+		unsigned int meshletCount;
+		unsigned long long stringOffset;
+		unsigned long long vertexOffset;
+		unsigned long long indexOffset;
+	};
+
+	struct MeshCacheEntry
+	{
+		unsigned int firstVertex;       // into the vertex block
+		unsigned int vertexCount;
+		unsigned int firstIndex;        // into the index block
+		unsigned int indexCount;
+		unsigned int firstTexture;      // into the texture table
+		unsigned int textureCount;
+		unsigned int firstLod;          // into the LOD table
+		unsigned int lodCount;
+		unsigned int firstMeshlet;      // into the meshlet table
+		unsigned int meshletCount;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	struct MeshCacheTexture
+	{
+		unsigned int type;              // offsets into the string block
+		unsigned int path;
+	};
+
+	struct MeshCacheLOD
+	{
+		unsigned int firstIndex;        // into the index block
+		unsigned int indexCount;
+		float error;                    // MeshLOD::error
+		unsigned int pad;
+	};
+
+	// path of the cache for a model file
+	std::string GetMeshCachePath(const std::string& modelPath);
+
+	// fills meshes from the cache of modelPath; false if there is no up to date cache.
+	// Without upload nothing touches GL: the geometry isn't uploaded and textures are listed with id 0, not loaded.
+	bool LoadMeshCache(const std::string& modelPath, std::vector<Mesh>& meshes, bool upload = true);
+	// writes the cache of modelPath from its freshly imported meshes
+	void SaveMeshCache(const std::string& modelPath, const std::vector<Mesh>& meshes);
+}
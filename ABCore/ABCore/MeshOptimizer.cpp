@@ -0,0 +1,264 @@
+#include "MeshOptimizer.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+using namespace AB;
+
+// the cache size to optimize for; most hardware has at least this much
+#define VERTEX_CACHE_SIZE 16
+
+void AB::WeldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			// FNV-1a over the bytes
+			const unsigned char* bytes = (const unsigned char*)&v;
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return (size_t)hash;
+		}
+	};
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+	};
+
+	unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+	unique.reserve(vertices.size());
+	vector<unsigned int> remap(vertices.size());
+	vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		auto it = unique.find(vertices[i]);
+		if (it == unique.end())
+		{
+			it = unique.emplace(vertices[i], (unsigned int)welded.size()).first;
+			welded.push_back(vertices[i]);
+		}
+		remap[i] = it->second;
+	}
+
+	for (unsigned int& index : indices)
+		index = remap[index];
+	vertices.swap(welded);
+}
+
+void AB::OptimizeVertexCache(vector<unsigned int>& indices, unsigned int vertexCount, vector<unsigned int>* clusters, unsigned int cacheSize)
+{
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+	if (clusters)
+		clusters->clear();
+	if (!triangleCount)
+		return;
+
+	// triangles around every vertex, as offsets into one array
+	vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (unsigned int index : indices)
+		liveTriangles[index]++;
+
+	vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+
+	vector<unsigned int> adjacency(indices.size());
+	vector<unsigned int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (unsigned int i = 0; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	vector<unsigned int> cacheTime(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<unsigned int> deadEnds;
+	vector<unsigned int> candidates;
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 0;
+	int fanning = 0;
+	bool coldStart = true;
+	while (fanning >= 0)
+	{
+		if (coldStart && clusters)
+			clusters->push_back((unsigned int)result.size() / 3);
+		coldStart = false;
+
+		// emit every triangle left around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = firstTriangle[fanning]; a < firstTriangle[fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = true;
+
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int v = indices[triangle * 3 + corner];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+		}
+
+		// next: the candidate still in the cache that has the most left to emit without falling out of it
+		int next = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (!liveTriangles[v])
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		// none: the most recent vertex with triangles left, or failing that the next one in order
+		if (next < 0)
+		{
+			while (!deadEnds.empty() && next < 0)
+			{
+				unsigned int v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[v])
+					next = v;
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (liveTriangles[cursor])
+				{
+					next = cursor;
+					coldStart = true;
+				}
+				cursor++;
+			}
+		}
+		fanning = next;
+	}
+
+	indices.swap(result);
+}
+
+void AB::OptimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, const vector<unsigned int>& clusters)
+{
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+	if (clusters.size() < 2)
+		return;
+
+	glm::vec3 meshCenter(0.f);
+	for (const Vertex& v : vertices)
+		meshCenter += v.Position;
+	meshCenter /= (float)vertices.size();
+
+	// how much a cluster faces away from the middle of the mesh; outward facing clusters occlude the most
+	struct Cluster
+	{
+		unsigned int first, end;
+		float sortKey;
+	};
+	vector<Cluster> sorted;
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		Cluster cluster;
+		cluster.first = clusters[c];
+		cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+		glm::vec3 center(0.f), normal(0.f);
+		float area = 0.f;
+		for (unsigned int t = cluster.first; t < cluster.end; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+			center += (p0 + p1 + p2) / 3.f * a;
+			normal += n;
+			area += a;
+		}
+		if (area > 0.f)
+			center /= area;
+		float length = glm::length(normal);
+		cluster.sortKey = length > 0.f ? glm::dot(center - meshCenter, normal / length) : 0.f;
+		sorted.push_back(cluster);
+	}
+
+	stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (const Cluster& cluster : sorted)
+		result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.end * 3);
+	indices.swap(result);
+}
+
+void AB::OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	const unsigned int unused = ~0u;
+	vector<unsigned int> remap(vertices.size(), unused);
+	vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = (unsigned int)ordered.size();
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	// vertices no triangle uses are dropped
+	vertices.swap(ordered);
+}
+
+float AB::ComputeACMR(const vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.f;
+
+	// FIFO: a vertex is in the cache if it went in fewer than cacheSize misses ago
+	vector<unsigned int> insertedAt(vertexCount, 0);
+	unsigned int misses = 0;
+	for (unsigned int index : indices)
+	{
+		if (!insertedAt[index] || misses + 1 - insertedAt[index] >= cacheSize)
+		{
+			misses++;
+			insertedAt[index] = misses;
+		}
+	}
+	return (float)misses / (indices.size() / 3);
+}
+
+void AB::OptimizeMesh(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	if (vertices.empty() || indices.size() < 3)
+		return;
+
+	WeldVertices(vertices, indices);
+
+	vector<unsigned int> clusters;
+	OptimizeVertexCache(indices, (unsigned int)vertices.size(), &clusters, VERTEX_CACHE_SIZE);
+	OptimizeOverdraw(indices, vertices, clusters);
+
+	OptimizeVertexFetch(vertices, indices);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "Mesh.h"
+
+namespace AB
+{
+	// Mesh optimization passes run on imported meshes before they're cached (see LoadModelMeshes).
+	// OptimizeMesh runs all of them in the order they need to be run in.
+
+	// merges vertices that are identical in every attribute. Importers that give every triangle corner its own
+	// vertex (Assimp's FBX importer does) leave nothing for the vertex cache to reuse without this.
+	void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// reorders triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007).
+	// clusters receives the first triangle of every run that starts with a cold cache, for OptimizeOverdraw.
+	void OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, std::vector<unsigned int>* clusters = nullptr, unsigned int cacheSize = 16);
+
+	// reorders the clusters from OptimizeVertexCache so the ones facing out of the mesh draw first and hide the
+	// ones behind them. Triangles inside a cluster keep their order, so the cache stays about as warm.
+	void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& clusters);
+
+	// renumbers vertices in the order the indices first use them, so vertex fetches walk the buffer forward
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// average cache miss ratio: vertices transformed per triangle with a FIFO cache of cacheSize (0.5 to 3, lower is better)
+	float ComputeACMR(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = 16);
+
+	// weld, vertex cache, overdraw, vertex fetch
+	void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+}
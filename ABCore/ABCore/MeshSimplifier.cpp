@@ -0,0 +1,336 @@
+#include "MeshSimplifier.h"
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+using namespace std;
+using namespace AB;
+
+// how much more an open border resists moving than the surface around it
+#define BORDER_WEIGHT 10.0
+
+namespace
+{
+	// sum of squared distances to a set of planes, each scaled by its weight: p^T A p with A symmetric 4x4.
+	// Dividing by the total weight gives the mean squared distance.
+	struct Quadric
+	{
+		double a[10] = {};      // a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+		double weight = 0.0;
+
+		Quadric() = default;
+
+		// the plane through point with the given unit normal
+		Quadric(const glm::dvec3& normal, const glm::dvec3& point, double planeWeight)
+		{
+			double d = -glm::dot(normal, point);
+			a[0] = normal.x * normal.x; a[1] = normal.x * normal.y; a[2] = normal.x * normal.z; a[3] = normal.x * d;
+			a[4] = normal.y * normal.y; a[5] = normal.y * normal.z; a[6] = normal.y * d;
+			a[7] = normal.z * normal.z; a[8] = normal.z * d;
+			a[9] = d * d;
+			for (double& value : a)
+				value *= planeWeight;
+			weight = planeWeight;
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			for (int i = 0; i < 10; i++)
+				a[i] += other.a[i];
+			weight += other.weight;
+			return *this;
+		}
+
+		// mean distance of p to the planes
+		double Error(const glm::dvec3& p) const
+		{
+			double sum = a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x
+				+ a[4] * p.y * p.y + 2.0 * a[5] * p.y * p.z + 2.0 * a[6] * p.y
+				+ a[7] * p.z * p.z + 2.0 * a[8] * p.z
+				+ a[9];
+			return weight > 0.0 ? sqrt(max(sum, 0.0) / weight) : 0.0;
+		}
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (size_t)((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u));
+		}
+	};
+
+	struct Collapse
+	{
+		unsigned int from, to;
+		float error;
+	};
+
+	uint64_t EdgeKey(unsigned int a, unsigned int b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+}
+
+vector<unsigned int> AB::SimplifyMesh(const vector<unsigned int>& indices, const float* vertices, unsigned int vertexCount,
+	size_t stride, unsigned int targetIndexCount, float maxError, float* error)
+{
+	size_t floatStride = stride / sizeof(float);
+	vector<unsigned int> result = indices;
+	if (error)
+		*error = 0.f;
+
+	// vertices at the same position share an id; wedges lists the vertices of each id
+	unordered_map<glm::vec3, unsigned int, PositionHash> ids;
+	vector<unsigned int> positionId(vertexCount);
+	vector<glm::dvec3> positions;
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		const float* p = vertices + v * floatStride;
+		auto it = ids.emplace(glm::vec3(p[0], p[1], p[2]), (unsigned int)positions.size()).first;
+		if (it->second == positions.size())
+			positions.push_back(glm::dvec3(it->first));
+		positionId[v] = it->second;
+	}
+	unsigned int idCount = (unsigned int)positions.size();
+
+	vector<unsigned int> wedgeStart(idCount + 1, 0), wedges(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		wedgeStart[positionId[v] + 1]++;
+	for (unsigned int id = 0; id < idCount; id++)
+		wedgeStart[id + 1] += wedgeStart[id];
+	{
+		vector<unsigned int> fill(wedgeStart.begin(), wedgeStart.end() - 1);
+		for (unsigned int v = 0; v < vertexCount; v++)
+			wedges[fill[positionId[v]]++] = v;
+	}
+
+	// every vertex starts with the planes of its triangles, weighted by area, and the borders it's on
+	vector<Quadric> quadrics(idCount);
+	unordered_map<uint64_t, unsigned int> edgeUse;
+	for (size_t t = 0; t + 2 < result.size(); t += 3)
+	{
+		unsigned int id[3] = { positionId[result[t]], positionId[result[t + 1]], positionId[result[t + 2]] };
+		glm::dvec3 p0 = positions[id[0]], p1 = positions[id[1]], p2 = positions[id[2]];
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(n) * 0.5;
+		if (area <= 0.0)
+			continue;
+
+		Quadric plane(n / (area * 2.0), p0, area);
+		for (int c = 0; c < 3; c++)
+		{
+			quadrics[id[c]] += plane;
+			edgeUse[EdgeKey(id[c], id[(c + 1) % 3])]++;
+		}
+	}
+	for (size_t t = 0; t + 2 < result.size(); t += 3)
+	{
+		unsigned int id[3] = { positionId[result[t]], positionId[result[t + 1]], positionId[result[t + 2]] };
+		glm::dvec3 p0 = positions[id[0]], p1 = positions[id[1]], p2 = positions[id[2]];
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		if (glm::length(n) <= 0.0)
+			continue;
+
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int a = id[c], b = id[(c + 1) % 3];
+			if (edgeUse[EdgeKey(a, b)] != 1)
+				continue;
+
+			// a plane through the border edge, perpendicular to the triangle, keeps the border where it is
+			glm::dvec3 pa = positions[a], pb = positions[b];
+			glm::dvec3 edge = pb - pa;
+			double length = glm::length(edge);
+			glm::dvec3 side = glm::cross(edge, n);
+			if (length <= 0.0 || glm::length(side) <= 0.0)
+				continue;
+
+			Quadric border(glm::normalize(side), pa, length * length * BORDER_WEIGHT);
+			quadrics[a] += border;
+			quadrics[b] += border;
+		}
+	}
+
+	const unsigned int none = ~0u;
+	vector<unsigned int> collapseTo(idCount, none);
+	vector<unsigned char> locked(idCount);
+	vector<unsigned int> triangleStart, triangles;
+	vector<uint64_t> edges;
+	vector<Collapse> collapses;
+	vector<unsigned int> neighbors, opposite;
+
+	// collapse in passes: rate every edge, then make the cheapest collapses that don't touch each other
+	while (result.size() > targetIndexCount)
+	{
+		unsigned int triangleCount = (unsigned int)result.size() / 3;
+
+		// triangles around every id
+		triangleStart.assign(idCount + 1, 0);
+		for (unsigned int index : result)
+			triangleStart[positionId[index] + 1]++;
+		for (unsigned int id = 0; id < idCount; id++)
+			triangleStart[id + 1] += triangleStart[id];
+		triangles.resize(result.size());
+		{
+			vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+			for (unsigned int i = 0; i < result.size(); i++)
+				triangles[fill[positionId[result[i]]]++] = i / 3;
+		}
+
+		edges.clear();
+		for (unsigned int t = 0; t < triangleCount; t++)
+		{
+			for (int c = 0; c < 3; c++)
+				edges.push_back(EdgeKey(positionId[result[t * 3 + c]], positionId[result[t * 3 + (c + 1) % 3]]));
+		}
+		sort(edges.begin(), edges.end());
+		edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+		// each edge collapses onto whichever end moves the surface least
+		collapses.clear();
+		for (uint64_t edge : edges)
+		{
+			unsigned int a = (unsigned int)(edge >> 32), b = (unsigned int)edge;
+			Quadric q = quadrics[a];
+			q += quadrics[b];
+			double toB = q.Error(positions[b]);
+			double toA = q.Error(positions[a]);
+			if (toB <= toA)
+				collapses.push_back({ a, b, (float)toB });
+			else
+				collapses.push_back({ b, a, (float)toA });
+		}
+		sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		fill(locked.begin(), locked.end(), 0);
+		unsigned int targetTriangles = targetIndexCount / 3;
+		unsigned int made = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > maxError || triangleCount <= targetTriangles)
+				break;
+			if (locked[collapse.from] || locked[collapse.to])
+				continue;
+
+			glm::dvec3 target = positions[collapse.to];
+			bool valid = true;
+			unsigned int removed = 0;
+			neighbors.clear();
+			opposite.clear();
+			for (unsigned int i = triangleStart[collapse.from]; i < triangleStart[collapse.from + 1] && valid; i++)
+			{
+				unsigned int t = triangles[i];
+				unsigned int id[3] = { positionId[result[t * 3]], positionId[result[t * 3 + 1]], positionId[result[t * 3 + 2]] };
+				for (int c = 0; c < 3; c++)
+				{
+					if (id[c] != collapse.from && id[c] != collapse.to)
+						neighbors.push_back(id[c]);
+				}
+
+				if (id[0] == collapse.to || id[1] == collapse.to || id[2] == collapse.to)
+				{
+					// goes away with the edge
+					removed++;
+					for (int c = 0; c < 3; c++)
+					{
+						if (id[c] != collapse.from && id[c] != collapse.to)
+							opposite.push_back(id[c]);
+					}
+					continue;
+				}
+
+				// no remaining triangle may flip over
+				glm::dvec3 p[3], moved[3];
+				for (int c = 0; c < 3; c++)
+				{
+					p[c] = positions[id[c]];
+					moved[c] = id[c] == collapse.from ? target : p[c];
+				}
+				glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				if (glm::dot(before, after) <= 0.0)
+					valid = false;
+			}
+			if (!valid)
+				continue;
+
+			// the ends may only share the neighbors across the triangles being removed, or the surface pinches together
+			sort(neighbors.begin(), neighbors.end());
+			neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+			for (unsigned int i = triangleStart[collapse.to]; i < triangleStart[collapse.to + 1] && valid; i++)
+			{
+				unsigned int t = triangles[i];
+				for (int c = 0; c < 3; c++)
+				{
+					unsigned int id = positionId[result[t * 3 + c]];
+					if (binary_search(neighbors.begin(), neighbors.end(), id) && find(opposite.begin(), opposite.end(), id) == opposite.end())
+						valid = false;
+				}
+			}
+			if (!valid)
+				continue;
+
+			collapseTo[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			locked[collapse.from] = locked[collapse.to] = 1;
+			for (unsigned int neighbor : neighbors)
+				locked[neighbor] = 1;
+
+			triangleCount -= removed;
+			made++;
+			if (error)
+				*error = max(*error, collapse.error);
+		}
+		if (!made)
+			break;
+
+		// move the corners of collapsed vertices, each to the vertex at its new position that looks most like it
+		size_t kept = 0;
+		for (size_t t = 0; t + 2 < result.size(); t += 3)
+		{
+			unsigned int corner[3];
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = result[t + c];
+				unsigned int to = collapseTo[positionId[v]];
+				if (to != none)
+				{
+					const float* attributes = vertices + v * floatStride;
+					float best = -1.f;
+					for (unsigned int w = wedgeStart[to]; w < wedgeStart[to + 1]; w++)
+					{
+						const float* candidate = vertices + wedges[w] * floatStride;
+						float distance = 0.f;
+						for (size_t f = 3; f < floatStride; f++)
+							distance += (candidate[f] - attributes[f]) * (candidate[f] - attributes[f]);
+						if (best < 0.f || distance < best)
+						{
+							best = distance;
+							v = wedges[w];
+						}
+					}
+				}
+				corner[c] = v;
+			}
+
+			unsigned int id0 = positionId[corner[0]], id1 = positionId[corner[1]], id2 = positionId[corner[2]];
+			if (id0 == id1 || id1 == id2 || id0 == id2)
+				continue;
+
+			result[kept++] = corner[0];
+			result[kept++] = corner[1];
+			result[kept++] = corner[2];
+		}
+		result.resize(kept);
+		fill(collapseTo.begin(), collapseTo.end(), none);
+	}
+
+	return result;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace AB
+{
+	// Quadric error metric simplification (Garland & Heckbert 1997).
+	//
+	// Edges are collapsed onto one of their two vertices, so the result indexes the same vertices as the input and
+	// can share its vertex buffer. Vertices are read as floats: the position first, then any other attributes up to
+	// stride bytes. Vertices at the same position are treated as one, so seams in the other attributes (flat shading,
+	// UV islands) don't stop the simplification; a corner that moves picks the vertex at its new position whose other
+	// attributes are closest to its own.
+	//
+	// Only depends on glm, so code outside ABCore can compile it on its own.
+
+	// simplifies until at most targetIndexCount indices are left, or until the next collapse would move the surface
+	// further than maxError (in the positions' units). error receives the largest error of the collapses made.
+	std::vector<unsigned int> SimplifyMesh(const std::vector<unsigned int>& indices, const float* vertices, unsigned int vertexCount,
+		size_t stride, unsigned int targetIndexCount, float maxError, float* error = nullptr);
+}
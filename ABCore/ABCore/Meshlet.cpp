@@ -0,0 +1,226 @@
+#include "Meshlet.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace AB;
+
+MeshletArena* MeshletArena::instance = nullptr;
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 layout of the culling shader's struct");
+
+// cones wider than this (the smallest dot of a triangle normal with the axis) hardly ever face away as a whole,
+// so they aren't worth testing
+#define MIN_CONE_DOT 0.1f
+
+// bounding sphere and normal cone of the triangles in meshlet's index range
+static void ComputeMeshletBounds(Meshlet& meshlet, const vector<Vertex>& vertices, const vector<unsigned int>& indices)
+{
+	AABB box;
+	for (unsigned int i = 0; i < meshlet.indexCount; i++)
+		box.Add(vertices[indices[meshlet.firstIndex + i]].Position);
+
+	meshlet.center = box.GetCenter();
+	float radiusSquared = 0.f;
+	for (unsigned int i = 0; i < meshlet.indexCount; i++)
+	{
+		glm::vec3 offset = vertices[indices[meshlet.firstIndex + i]].Position - meshlet.center;
+		radiusSquared = max(radiusSquared, glm::dot(offset, offset));
+	}
+	meshlet.radius = sqrt(radiusSquared);
+
+	// the axis is the average of the triangles' normals, and the cone as wide as the one furthest from it
+	vector<glm::vec3> normals;
+	glm::vec3 axis(0.f);
+	for (unsigned int i = 0; i < meshlet.indexCount; i += 3)
+	{
+		const glm::vec3& a = vertices[indices[meshlet.firstIndex + i]].Position;
+		const glm::vec3& b = vertices[indices[meshlet.firstIndex + i + 1]].Position;
+		const glm::vec3& c = vertices[indices[meshlet.firstIndex + i + 2]].Position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float length = glm::length(normal);
+		if (length == 0.f)
+			continue;
+
+		normals.push_back(normal / length);
+		axis += normals.back();
+	}
+
+	meshlet.coneAxis = glm::vec3(0.f);
+	meshlet.coneCutoff = 1.f;
+	float axisLength = glm::length(axis);
+	if (normals.empty() || axisLength == 0.f)
+		return;
+
+	axis /= axisLength;
+	float minDot = 1.f;
+	for (const glm::vec3& normal : normals)
+		minDot = min(minDot, glm::dot(normal, axis));
+
+	meshlet.coneAxis = axis;
+	if (minDot > MIN_CONE_DOT)
+		meshlet.coneCutoff = sqrt(1.f - minDot * minDot);
+}
+
+vector<Meshlet> AB::BuildMeshlets(const vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	vector<Meshlet> meshlets;
+	size_t triangleCount = indices.size() / 3;
+	if (!triangleCount)
+		return meshlets;
+
+	// the triangles around every vertex: vertexTriangles[firstTriangle[v]] up to firstTriangle[v + 1]
+	vector<unsigned int> firstTriangle(vertices.size() + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		firstTriangle[indices[i] + 1]++;
+	for (size_t v = 0; v < vertices.size(); v++)
+		firstTriangle[v + 1] += firstTriangle[v];
+	vector<unsigned int> vertexTriangles(triangleCount * 3);
+	vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		vertexTriangles[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+	vector<unsigned char> used(triangleCount, 0);
+	// the meshlet each vertex was last added to
+	vector<unsigned int> vertexMeshlet(vertices.size(), ~0u);
+	vector<unsigned int> meshletVertices;
+	vector<unsigned int> ordered, local;
+	ordered.reserve(triangleCount * 3);
+
+	// vertices a triangle would add to the current meshlet, counting a vertex it uses twice once
+	auto newVertices = [&](size_t triangle, unsigned int id)
+	{
+		unsigned int a = indices[triangle * 3], b = indices[triangle * 3 + 1], c = indices[triangle * 3 + 2];
+		return (vertexMeshlet[a] != id) + (vertexMeshlet[b] != id && b != a) + (vertexMeshlet[c] != id && c != a && c != b);
+	};
+
+	size_t seed = 0;
+	while (true)
+	{
+		// every meshlet starts at the first triangle left in the original order, so they come out in about the order
+		// the vertex cache optimization left the triangles in
+		while (seed < triangleCount && used[seed])
+			seed++;
+		if (seed == triangleCount)
+			break;
+
+		unsigned int id = (unsigned int)meshlets.size();
+		Meshlet meshlet = {};
+		meshlet.firstIndex = (unsigned int)ordered.size();
+		meshletVertices.clear();
+		glm::vec3 positionSum(0.f);
+
+		size_t triangle = seed;
+		while (true)
+		{
+			used[triangle] = 1;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int v = indices[triangle * 3 + corner];
+				ordered.push_back(v);
+				if (vertexMeshlet[v] != id)
+				{
+					vertexMeshlet[v] = id;
+					meshletVertices.push_back(v);
+					positionSum += vertices[v].Position;
+				}
+			}
+			meshlet.indexCount += 3;
+			if (meshlet.indexCount == MAX_MESHLET_TRIANGLES * 3)
+				break;
+
+			// grow into the triangle around the meshlet's vertices that adds the fewest vertices, and of those the one
+			// closest to its center, which keeps meshlets round and their bounds tight
+			glm::vec3 center = positionSum / (float)meshletVertices.size();
+			size_t best = triangleCount;
+			unsigned int bestNewVertices = 4;
+			float bestDistance = 0.f;
+			for (unsigned int v : meshletVertices)
+			{
+				for (unsigned int t = firstTriangle[v]; t < firstTriangle[v + 1]; t++)
+				{
+					unsigned int candidate = vertexTriangles[t];
+					if (used[candidate])
+						continue;
+
+					unsigned int added = newVertices(candidate, id);
+					if (meshletVertices.size() + added > MAX_MESHLET_VERTICES || added > bestNewVertices)
+						continue;
+
+					const glm::vec3& a = vertices[indices[candidate * 3]].Position;
+					const glm::vec3& b = vertices[indices[candidate * 3 + 1]].Position;
+					const glm::vec3& c = vertices[indices[candidate * 3 + 2]].Position;
+					glm::vec3 offset = (a + b + c) / 3.f - center;
+					float distance = glm::dot(offset, offset);
+					if (added < bestNewVertices || distance < bestDistance)
+					{
+						best = candidate;
+						bestNewVertices = added;
+						bestDistance = distance;
+					}
+				}
+			}
+
+			// the meshlet is full, or its part of the mesh is used up
+			if (best == triangleCount)
+				break;
+			triangle = best;
+		}
+
+		// growth order is poor for the vertex cache, so order the meshlet's triangles again, renumbering its
+		// vertices so that only needs as much memory as there are of them
+		local.assign(ordered.begin() + meshlet.firstIndex, ordered.end());
+		for (unsigned int& index : local)
+			for (unsigned int i = 0; i < meshletVertices.size(); i++)
+				if (meshletVertices[i] == index)
+				{
+					index = i;
+					break;
+				}
+		OptimizeVertexCache(local, (unsigned int)meshletVertices.size());
+		for (unsigned int i = 0; i < meshlet.indexCount; i++)
+			ordered[meshlet.firstIndex + i] = meshletVertices[local[i]];
+
+		ComputeMeshletBounds(meshlet, vertices, ordered);
+		meshlets.push_back(meshlet);
+	}
+
+	indices.swap(ordered);
+	return meshlets;
+}
+
+unsigned int MeshletArena::Allocate(const Meshlet* newMeshlets, unsigned int count)
+{
+	unsigned int first = ranges.Allocate(count);
+	if (ranges.GetEnd() > meshlets.size())
+		meshlets.resize(ranges.GetEnd());
+	Update(first, newMeshlets, count);
+	return first;
+}
+
+void MeshletArena::Update(unsigned int first, const Meshlet* newMeshlets, unsigned int count)
+{
+	copy(newMeshlets, newMeshlets + count, meshlets.begin() + first);
+	dirty = true;
+}
+
+void MeshletArena::Free(unsigned int first, unsigned int count)
+{
+	ranges.Free(first, count);
+	// freed meshlets at the end don't need uploading anymore; ones in between are never read
+	meshlets.resize(ranges.GetEnd());
+}
+
+void MeshletArena::Bind()
+{
+	if (!buffer.ID)
+		buffer = StorageBuffer((unsigned int)max<size_t>(meshlets.size(), 1) * sizeof(Meshlet), MESHLET_BINDING);
+
+	if (dirty && !meshlets.empty())
+		buffer.Upload(meshlets.data(), (unsigned int)(meshlets.size() * sizeof(Meshlet)));
+	dirty = false;
+	buffer.Bind();
+}
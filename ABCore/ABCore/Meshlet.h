@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "UniformBuffer.h"
+#include "RangeAllocator.h"
+
+namespace AB
+{
+	struct Vertex;
+
+	const unsigned int MAX_MESHLET_VERTICES = 64;
+	const unsigned int MAX_MESHLET_TRIANGLES = 124;
+
+	// A cluster of up to MAX_MESHLET_TRIANGLES consecutive triangles of a mesh, touching at most MAX_MESHLET_VERTICES
+	// vertices, which the cluster culling pass culls on its own (see OcclusionCuller::CullClusters).
+	// std430 layout of one element of "buffer Meshlets".
+	struct Meshlet
+	{
+		// bounding sphere, in the mesh's space
+		glm::vec3 center;
+		float radius;
+		// normal cone: seen from camera, every triangle faces away if
+		// dot(center - camera, coneAxis) >= coneCutoff * length(center - camera) + radius. A cutoff of 1 never culls.
+		glm::vec3 coneAxis;
+		float coneCutoff;
+		// the triangles' index range. Relative to the mesh's indices on the CPU; in the MeshletArena, absolute in the
+		// mesh's GeometryArena along with its baseVertex.
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		int baseVertex;
+		unsigned int pad;
+	};
+
+	// splits the triangles into meshlets, growing each one from a triangle into its neighbours so it stays compact,
+	// and reorders the indices so every meshlet's triangles are consecutive. Meshlets are small enough that the
+	// vertex cache order inside them is about as good as the order they were in (see MeshOptimizer.h).
+	std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// Singleton holding the meshlets of every uploaded mesh in one storage buffer at MESHLET_BINDING.
+	// Like the GeometryArena, ranges are never freed. It keeps a copy of every meshlet and uploads all of them
+	// the next time it's bound after any were added; meshes are loaded far less often than they are drawn.
+	class MeshletArena
+	{
+	public:
+
+		static MeshletArena& Get()
+		{
+			if (!instance)
+				instance = new MeshletArena();
+			return *instance;
+		}
+
+		MeshletArena(MeshletArena const&) = delete;
+		void operator=(MeshletArena const&) = delete;
+
+		// copies the meshlets in; returns the index of the first one
+		unsigned int Allocate(const Meshlet* meshlets, unsigned int count);
+		// overwrites meshlets returned by Allocate
+		void Update(unsigned int first, const Meshlet* meshlets, unsigned int count);
+		// gives meshlets returned by Allocate back for reuse
+		void Free(unsigned int first, unsigned int count);
+
+		// uploads any changes and binds the buffer to MESHLET_BINDING
+		void Bind();
+
+		unsigned int GetCount() const { return (unsigned int)meshlets.size(); }
+
+	private:
+
+		static MeshletArena* instance;
+
+		MeshletArena() = default;
+
+		std::vector<Meshlet> meshlets;
+		RangeAllocator ranges;
+		StorageBuffer buffer;
+		bool dirty = false;
+	};
+}
@@ -0,0 +1,287 @@
+#include "NormalGenerator.h"
+
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define NORMALS_SSE
+#endif
+
+// fewer triangles than this per thread and starting the threads takes longer than the work
+#define MIN_TRIANGLES_PER_THREAD 16384
+
+using namespace std;
+using namespace AB;
+
+namespace
+{
+	// runs f(begin, end) on threadCount threads, splitting [0, count) into even ranges
+	template<class F> void ParallelRanges(unsigned int threadCount, size_t count, F f)
+	{
+		vector<thread> workers;
+		for (unsigned int t = 1; t < threadCount; t++)
+			workers.emplace_back(f, count * t / threadCount, count * (t + 1) / threadCount);
+		f((size_t)0, count / threadCount);
+		for (thread& worker : workers)
+			worker.join();
+	}
+
+	// normalizes the vectors begin to end of x, y and z in place; zero vectors stay zero
+	void Normalize(float* x, float* y, float* z, size_t begin, size_t end)
+	{
+		size_t i = begin;
+#ifdef NORMALS_SSE
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+			// 1 / 0 is infinite, which the mask turns into a zero scale
+			__m128 scale = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.f), length), _mm_cmpgt_ps(length, _mm_setzero_ps()));
+			_mm_storeu_ps(x + i, _mm_mul_ps(vx, scale));
+			_mm_storeu_ps(y + i, _mm_mul_ps(vy, scale));
+			_mm_storeu_ps(z + i, _mm_mul_ps(vz, scale));
+		}
+#endif
+
+		// whatever is left (or everything, without SSE)
+		for (; i < end; i++)
+		{
+			float length = sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+			float scale = length > 0.f ? 1.f / length : 0.f;
+			x[i] *= scale;
+			y[i] *= scale;
+			z[i] *= scale;
+		}
+	}
+
+	// Sorts the items 0 to count - 1 into threadCount buckets by bucketOf(item), keeping them in order within each
+	// bucket. Each thread counts, then places, its own range of items, so bucket b ends up in items[starts[b]] to
+	// items[starts[b + 1]] after two passes over the items however many threads there are.
+	template<class F> void Partition(unsigned int threadCount, size_t count, F bucketOf, vector<unsigned int>& items, vector<size_t>& starts)
+	{
+		starts.assign(threadCount + 1, 0);
+		starts[threadCount] = count;
+		items.resize(count);
+		if (threadCount == 1)
+		{
+			for (size_t i = 0; i < count; i++)
+				items[i] = (unsigned int)i;
+			return;
+		}
+
+		// counts[range * threadCount + bucket], then where that range's items of that bucket go
+		vector<size_t> counts((size_t)threadCount * threadCount);
+		ParallelRanges(threadCount, threadCount, [&](size_t begin, size_t end)
+		{
+			for (size_t range = begin; range < end; range++)
+			{
+				size_t* rangeCounts = &counts[range * threadCount];
+				for (size_t i = count * range / threadCount, last = count * (range + 1) / threadCount; i < last; i++)
+					rangeCounts[bucketOf(i)]++;
+			}
+		});
+
+		size_t offset = 0;
+		for (unsigned int bucket = 0; bucket < threadCount; bucket++)
+		{
+			starts[bucket] = offset;
+			for (unsigned int range = 0; range < threadCount; range++)
+			{
+				size_t n = counts[(size_t)range * threadCount + bucket];
+				counts[(size_t)range * threadCount + bucket] = offset;
+				offset += n;
+			}
+		}
+
+		ParallelRanges(threadCount, threadCount, [&](size_t begin, size_t end)
+		{
+			for (size_t range = begin; range < end; range++)
+			{
+				size_t* next = &counts[range * threadCount];
+				for (size_t i = count * range / threadCount, last = count * (range + 1) / threadCount; i < last; i++)
+					items[next[bucketOf(i)]++] = (unsigned int)i;
+			}
+		});
+	}
+
+	uint64_t HashPosition(const float* p)
+	{
+		uint32_t bits[3];
+		memcpy(bits, p, sizeof(bits));
+		uint64_t h = bits[0] * 0x9E3779B97F4A7C15ull ^ bits[1] * 0xC2B2AE3D27D4EB4Full ^ bits[2] * 0x165667B19E3779F9ull;
+		return h ^ (h >> 29);
+	}
+}
+
+void AB::GenerateNormals(const unsigned int* indices, size_t indexCount, const float* vertices, unsigned int vertexCount,
+	size_t stride, float* normals, size_t normalStride, bool mergePositions, float* faceNormals, unsigned int threadCount)
+{
+	size_t floatStride = stride / sizeof(float);
+	size_t normalFloatStride = normalStride / sizeof(float);
+	size_t triangleCount = indexCount / 3;
+
+	if (!threadCount)
+		threadCount = max(1u, thread::hardware_concurrency());
+	threadCount = (unsigned int)max<size_t>(1, min<size_t>(threadCount, triangleCount / MIN_TRIANGLES_PER_THREAD));
+
+	// the positions, padded to four floats so SSE can load a whole one
+	vector<float> points((size_t)vertexCount * 4);
+	ParallelRanges(threadCount, vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const float* p = vertices + v * floatStride;
+			float* point = &points[v * 4];
+			point[0] = p[0];
+			point[1] = p[1];
+			point[2] = p[2];
+			point[3] = 0.f;
+		}
+	});
+
+	// when merging, every vertex stands for the first vertex at its position, and the indices are rewritten to
+	// those. The vertices are partitioned by their hash, so each thread fills a table with only its share of
+	// them, in vertex order, and comes to the same result as one thread would.
+	vector<unsigned int> first;
+	vector<unsigned int> merged;
+	const unsigned int* corners = indices;
+	if (mergePositions)
+	{
+		vector<unsigned int> byHash;
+		vector<size_t> shareStarts;
+		Partition(threadCount, vertexCount, [&](size_t v) { return (unsigned int)(HashPosition(&points[v * 4]) >> 40) % threadCount; }, byHash, shareStarts);
+
+		first.resize(vertexCount);
+		ParallelRanges(threadCount, threadCount, [&](size_t begin, size_t end)
+		{
+			for (size_t share = begin; share < end; share++)
+			{
+				size_t capacity = 16;
+				while (capacity < (shareStarts[share + 1] - shareStarts[share]) * 2)
+					capacity *= 2;
+				vector<unsigned int> slots(capacity, ~0u);
+
+				for (size_t i = shareStarts[share]; i < shareStarts[share + 1]; i++)
+				{
+					unsigned int v = byHash[i];
+					const float* p = &points[(size_t)v * 4];
+					size_t slot = (size_t)HashPosition(p) & (capacity - 1);
+					while (slots[slot] != ~0u)
+					{
+						const float* other = &points[(size_t)slots[slot] * 4];
+						if (other[0] == p[0] && other[1] == p[1] && other[2] == p[2])
+							break;
+						slot = (slot + 1) & (capacity - 1);
+					}
+					if (slots[slot] == ~0u)
+						slots[slot] = v;
+					first[v] = slots[slot];
+				}
+			}
+		});
+
+		merged.resize(indexCount);
+		ParallelRanges(threadCount, indexCount, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				merged[i] = first[indices[i]];
+		});
+		corners = merged.data();
+	}
+
+	// the triangles' normals, as long as twice their area
+	vector<float> fx(triangleCount), fy(triangleCount), fz(triangleCount);
+	ParallelRanges(threadCount, triangleCount, [&](size_t begin, size_t end)
+	{
+		size_t t = begin;
+#ifdef NORMALS_SSE
+		// four triangles at a time: load their corners whole, and transpose them to x, y and z across the triangles
+		for (; t + 4 <= end; t += 4)
+		{
+			const unsigned int* corner = corners + t * 3;
+			__m128 a0 = _mm_loadu_ps(&points[(size_t)corner[0] * 4]), b0 = _mm_loadu_ps(&points[(size_t)corner[1] * 4]), c0 = _mm_loadu_ps(&points[(size_t)corner[2] * 4]);
+			__m128 a1 = _mm_loadu_ps(&points[(size_t)corner[3] * 4]), b1 = _mm_loadu_ps(&points[(size_t)corner[4] * 4]), c1 = _mm_loadu_ps(&points[(size_t)corner[5] * 4]);
+			__m128 a2 = _mm_loadu_ps(&points[(size_t)corner[6] * 4]), b2 = _mm_loadu_ps(&points[(size_t)corner[7] * 4]), c2 = _mm_loadu_ps(&points[(size_t)corner[8] * 4]);
+			__m128 a3 = _mm_loadu_ps(&points[(size_t)corner[9] * 4]), b3 = _mm_loadu_ps(&points[(size_t)corner[10] * 4]), c3 = _mm_loadu_ps(&points[(size_t)corner[11] * 4]);
+			_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+			_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+			__m128 ux = _mm_sub_ps(b0, a0), uy = _mm_sub_ps(b1, a1), uz = _mm_sub_ps(b2, a2);
+			__m128 vx = _mm_sub_ps(c0, a0), vy = _mm_sub_ps(c1, a1), vz = _mm_sub_ps(c2, a2);
+			_mm_storeu_ps(&fx[t], _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy)));
+			_mm_storeu_ps(&fy[t], _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz)));
+			_mm_storeu_ps(&fz[t], _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx)));
+		}
+#endif
+
+		for (; t < end; t++)
+		{
+			const float* a = &points[(size_t)corners[t * 3] * 4];
+			const float* b = &points[(size_t)corners[t * 3 + 1] * 4];
+			const float* c = &points[(size_t)corners[t * 3 + 2] * 4];
+			float ux = b[0] - a[0], uy = b[1] - a[1], uz = b[2] - a[2];
+			float vx = c[0] - a[0], vy = c[1] - a[1], vz = c[2] - a[2];
+			fx[t] = uy * vz - uz * vy;
+			fy[t] = uz * vx - ux * vz;
+			fz[t] = ux * vy - uy * vx;
+		}
+	});
+
+	// the corners, grouped by which thread's range of vertices they belong to and in triangle order within each
+	// group. Each thread then sums the triangles of its own vertices, so nothing is written by two threads, no
+	// corner is looked at twice, and every vertex adds up its triangles in the same order for any thread count.
+	unsigned int verticesPerThread = (unsigned int)max<size_t>(1, ((size_t)vertexCount + threadCount - 1) / threadCount);
+	vector<unsigned int> byOwner;
+	vector<size_t> ownerStarts;
+	Partition(threadCount, triangleCount * 3, [&](size_t corner) { return corners[corner] / verticesPerThread; }, byOwner, ownerStarts);
+
+	vector<float> sx(vertexCount), sy(vertexCount), sz(vertexCount);
+	ParallelRanges(threadCount, threadCount, [&](size_t firstOwner, size_t lastOwner)
+	{
+		for (size_t owner = firstOwner; owner < lastOwner; owner++)
+		{
+			for (size_t i = ownerStarts[owner]; i < ownerStarts[owner + 1]; i++)
+			{
+				size_t v = corners[byOwner[i]];
+				size_t t = byOwner[i] / 3;
+				sx[v] += fx[t];
+				sy[v] += fy[t];
+				sz[v] += fz[t];
+			}
+			size_t begin = min<size_t>(vertexCount, owner * verticesPerThread);
+			Normalize(sx.data(), sy.data(), sz.data(), begin, min<size_t>(vertexCount, begin + verticesPerThread));
+		}
+	});
+
+	ParallelRanges(threadCount, vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			float* normal = normals + v * normalFloatStride;
+			size_t from = mergePositions ? first[v] : v;
+			normal[0] = sx[from];
+			normal[1] = sy[from];
+			normal[2] = sz[from];
+		}
+	});
+
+	if (faceNormals)
+	{
+		ParallelRanges(threadCount, triangleCount, [&](size_t begin, size_t end)
+		{
+			Normalize(fx.data(), fy.data(), fz.data(), begin, end);
+			for (size_t t = begin; t < end; t++)
+			{
+				faceNormals[t * 3] = fx[t];
+				faceNormals[t * 3 + 1] = fy[t];
+				faceNormals[t * 3 + 2] = fz[t];
+			}
+		});
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+namespace AB
+{
+	// Smooth vertex normals, for meshes that come without any.
+	//
+	// Every vertex gets the average of the normals of the triangles around it, weighted by their area. With
+	// mergePositions, vertices at the same position are treated as one, so meshes split at UV seams (or with a vertex
+	// per triangle corner, as importers give OBJ files) come out smooth instead of faceted; without it, vertices that
+	// were split on purpose keep their hard edges. Vertices are read as floats with the position first; normals are
+	// written as three floats at the start of each normalStride bytes, so they can go straight into the vertices.
+	// Vertices no triangle uses get a zero normal.
+	//
+	// The triangle corners are partitioned by which thread's range of vertices they belong to, keeping triangle order,
+	// and each thread sums its own vertices. The work doesn't grow with the thread count, and every vertex adds up its
+	// triangles in the same order, so the result is the same for any thread count.
+	// Only depends on the standard library, so code outside ABCore can compile it on its own.
+
+	// faceNormals, if given, receives a unit normal per triangle (three floats each). threadCount 0 uses every core.
+	void GenerateNormals(const unsigned int* indices, size_t indexCount, const float* vertices, unsigned int vertexCount,
+		size_t stride, float* normals, size_t normalStride, bool mergePositions, float* faceNormals = nullptr,
+		unsigned int threadCount = 0);
+}
@@ -0,0 +1,183 @@
+#include "OcclusionCuller.h"
+#include "RenderState.h"
+#include "Meshlet.h"
+#include "Culling.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace AB;
+
+// must match local_size in the compute shaders
+#define DOWNSAMPLE_GROUP_SIZE 8
+#define CULL_GROUP_SIZE 64
+
+// texture unit the compute shaders sample from
+#define HIZ_TEXTURE_UNIT 0
+
+OcclusionCuller::OcclusionCuller(const string& shaderDirectory)
+{
+	downsampleShader = Shader((shaderDirectory + "hiz_downsample.comp").c_str());
+	cullShader = Shader((shaderDirectory + "occlusion_cull.comp").c_str());
+	clusterShader = Shader((shaderDirectory + "cluster_cull.comp").c_str());
+
+	boundsBuffer = StorageBuffer(sizeof(InstanceBounds), INSTANCE_BOUNDS_BINDING);
+	visibleBuffer = StorageBuffer(sizeof(unsigned int), VISIBLE_INSTANCE_BINDING);
+	visibilityBuffer = StorageBuffer(sizeof(unsigned int), DRAW_VISIBILITY_BINDING);
+
+	clusterItemBuffer = StorageBuffer(sizeof(ClusterItem), CLUSTER_ITEM_BINDING);
+	clusterBatchBuffer = StorageBuffer(sizeof(ClusterBatch), CLUSTER_BATCH_BINDING);
+	// bound to DrawVisibility while cluster_cull.comp runs
+	clusterVisibilityBuffer = StorageBuffer(sizeof(unsigned int), DRAW_VISIBILITY_BINDING);
+}
+
+// makes room for the visibility flags of ids up to idCount. New ids start out as not visible, so phase 2 tests them;
+// growing forgets the old flags for a frame.
+static void ReserveVisibility(StorageBuffer& buffer, unsigned int& count, unsigned int idCount)
+{
+	if (idCount <= count)
+		return;
+
+	count = max(idCount, count * 2);
+	vector<unsigned int> flags(count, 0);
+	buffer.Upload(flags.data(), count * sizeof(unsigned int));
+}
+
+void OcclusionCuller::SetDepthTexture(unsigned int texture, int newWidth, int newHeight)
+{
+	depthTexture = texture;
+	if (hiZ && newWidth == width && newHeight == height)
+		return;
+
+	width = newWidth;
+	height = newHeight;
+
+	// level 0 is half the depth buffer, down to 1x1
+	int hiZWidth = max((width + 1) / 2, 1);
+	int hiZHeight = max((height + 1) / 2, 1);
+	hiZLevels = 1;
+	for (int size = max(hiZWidth, hiZHeight); size > 1; size = (size + 1) / 2)
+		hiZLevels++;
+
+	RenderState& state = RenderState::Get();
+	if (hiZ)
+	{
+		state.OnTextureDeleted(hiZ);
+		glDeleteTextures(1, &hiZ);
+	}
+
+	// immutable storage so every level is complete for texelFetch and image stores
+	glGenTextures(1, &hiZ);
+	state.BindTexture(HIZ_TEXTURE_UNIT, hiZ);
+	glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, hiZWidth, hiZHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void OcclusionCuller::Upload(const vector<InstanceBounds>& bounds, unsigned int drawIdCount)
+{
+	instanceCount = (unsigned int)bounds.size();
+	if (!instanceCount)
+		return;
+
+	boundsBuffer.Upload(bounds.data(), instanceCount * sizeof(InstanceBounds));
+	// each phase writes its own range, at the same offsets as the instances themselves
+	visibleBuffer.Reserve(2 * instanceCount * sizeof(unsigned int));
+
+	ReserveVisibility(visibilityBuffer, visibilityCount, drawIdCount);
+}
+
+void OcclusionCuller::UploadClusters(const vector<ClusterItem>& items, const vector<ClusterBatch>& batches, unsigned int clusterIdCount)
+{
+	clusterItemCount = (unsigned int)items.size();
+	if (!clusterItemCount)
+		return;
+
+	clusterItemBuffer.Upload(items.data(), clusterItemCount * sizeof(ClusterItem));
+	clusterBatchBuffer.Upload(batches.data(), (unsigned int)(batches.size() * sizeof(ClusterBatch)));
+	ReserveVisibility(clusterVisibilityBuffer, clusterVisibilityCount, clusterIdCount);
+}
+
+void OcclusionCuller::BuildHiZ()
+{
+	if (!hiZ)
+	{
+		cout << "ERROR: OcclusionCuller::BuildHiZ called before SetDepthTexture" << endl;
+		return;
+	}
+
+	RenderState& state = RenderState::Get();
+	downsampleShader.use();
+	downsampleShader.SetInt("source", HIZ_TEXTURE_UNIT);
+
+	int levelWidth = max((width + 1) / 2, 1);
+	int levelHeight = max((height + 1) / 2, 1);
+	for (int level = 0; level < hiZLevels; level++)
+	{
+		// level 0 reads the depth buffer, every other level the one above it
+		state.BindTexture(HIZ_TEXTURE_UNIT, level ? hiZ : depthTexture);
+		downsampleShader.SetInt("sourceLevel", level ? level - 1 : 0);
+		glBindImageTexture(0, hiZ, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute((levelWidth + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, (levelHeight + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		levelWidth = max((levelWidth + 1) / 2, 1);
+		levelHeight = max((levelHeight + 1) / 2, 1);
+	}
+}
+
+void OcclusionCuller::Cull(int phase, unsigned int commandOffset, const glm::mat4& viewProjection)
+{
+	if (!instanceCount)
+		return;
+
+	boundsBuffer.Bind();
+	visibleBuffer.Bind();
+	visibilityBuffer.Bind();
+
+	cullShader.use();
+	cullShader.SetUint("instanceCount", instanceCount);
+	cullShader.SetUint("phase", (unsigned int)phase);
+	cullShader.SetUint("commandOffset", commandOffset);
+	cullShader.SetMatrix4x4("viewProjection", viewProjection);
+	cullShader.SetInt("hiZ", HIZ_TEXTURE_UNIT);
+	cullShader.SetVector2("depthSize", glm::vec2((float)width, (float)height));
+	RenderState::Get().BindTexture(HIZ_TEXTURE_UNIT, hiZ);
+
+	glDispatchCompute((instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	// the results are read as indirect commands, as vertex attributes and by the next phase
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void OcclusionCuller::CullClusters(int phase, unsigned int batchOffset, const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+	if (!clusterItemCount)
+		return;
+
+	MeshletArena::Get().Bind();
+	clusterItemBuffer.Bind();
+	clusterBatchBuffer.Bind();
+	clusterVisibilityBuffer.Bind();
+
+	clusterShader.use();
+	clusterShader.SetUint("itemCount", clusterItemCount);
+	clusterShader.SetUint("phase", (unsigned int)phase);
+	clusterShader.SetUint("batchOffset", batchOffset);
+	clusterShader.SetMatrix4x4("viewProjection", viewProjection);
+	clusterShader.SetVector3("cameraPosition", cameraPosition);
+	Frustum frustum(viewProjection);
+	for (int i = 0; i < 6; i++)
+		clusterShader.SetVector4("frustum[" + to_string(i) + "]", frustum.planes[i]);
+	clusterShader.SetInt("hiZ", HIZ_TEXTURE_UNIT);
+	clusterShader.SetVector2("depthSize", glm::vec2((float)width, (float)height));
+	RenderState::Get().BindTexture(HIZ_TEXTURE_UNIT, hiZ);
+
+	glDispatchCompute((clusterItemCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	// the results are read as indirect commands and draw counts, and by the next phase
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "Shader.h"
+#include "UniformBuffer.h"
+
+namespace AB
+{
+	// GPU occlusion culling against a hierarchical depth (Hi-Z) pyramid, in two phases per frame:
+	//   1. instances that were visible last frame are drawn without testing them
+	//   2. the pyramid is built from the depth those draws left, every instance is tested against it, and
+	//      the visible ones phase 1 missed are drawn as well
+	// Both phases write into the instanceCount of indirect draw commands and a list of visible instance indices,
+	// so nothing is read back to the CPU. Visibility is remembered per drawId, which the caller keeps stable between frames.
+	//
+	// Instances of clustered meshes can be culled per meshlet instead, in the same two phases (CullClusters), which
+	// also culls meshlets outside the frustum or facing away from the camera. Those append one draw command per
+	// visible meshlet, and remember visibility per clusterId.
+	class OcclusionCuller
+	{
+	public:
+
+		OcclusionCuller() = default;
+		// shaderDirectory holds hiz_downsample.comp, occlusion_cull.comp and cluster_cull.comp
+		OcclusionCuller(const std::string& shaderDirectory);
+
+		// the depth buffer the pyramid is built from; call again when it's resized
+		void SetDepthTexture(unsigned int texture, int width, int height);
+
+		// uploads the frame's instances; drawIdCount is one past the largest drawId among them
+		void Upload(const std::vector<InstanceBounds>& bounds, unsigned int drawIdCount);
+
+		// phase 1 or 2 over the uploaded instances. The commands of both phases must be in the DRAW_COMMAND_BINDING
+		// buffer with instanceCount 0, phase 2's following phase 1's at commandOffset.
+		void Cull(int phase, unsigned int commandOffset, const glm::mat4& viewProjection);
+
+		// uploads the frame's meshlets to cull, and the batches their commands go to: phase 1's, then phase 2's,
+		// each with commandCount 0 and room for all of its items' commands. clusterIdCount is one past the largest clusterId.
+		void UploadClusters(const std::vector<ClusterItem>& items, const std::vector<ClusterBatch>& batches, unsigned int clusterIdCount);
+
+		// phase 1 or 2 over the uploaded meshlets, reading the world matrices from the INSTANCE_DATA_BINDING buffer.
+		// Phase 2's batches follow phase 1's at batchOffset.
+		void CullClusters(int phase, unsigned int batchOffset, const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+		// the ClusterBatches written by CullClusters, whose commandCounts are draw counts for GL_PARAMETER_BUFFER
+		unsigned int GetClusterBatchBuffer() const { return clusterBatchBuffer.ID; }
+
+		// downsamples the depth texture into the pyramid; call between the phases
+		void BuildHiZ();
+
+		// the visible instance indices written by Cull, for GeometryArena::SetInstanceIndexBuffer
+		unsigned int GetVisibleInstanceBuffer() const { return visibleBuffer.ID; }
+
+		bool IsReady() const { return hiZ != 0; }
+
+	private:
+
+		Shader downsampleShader;
+		Shader cullShader;
+		Shader clusterShader;
+
+		unsigned int depthTexture = 0;
+		unsigned int hiZ = 0;
+		int width = 0, height = 0;
+		int hiZLevels = 0;
+
+		StorageBuffer boundsBuffer;
+		StorageBuffer visibleBuffer;
+		StorageBuffer visibilityBuffer;
+		unsigned int instanceCount = 0;
+		unsigned int visibilityCount = 0;
+
+		StorageBuffer clusterItemBuffer;
+		StorageBuffer clusterBatchBuffer;
+		StorageBuffer clusterVisibilityBuffer;
+		unsigned int clusterItemCount = 0;
+		unsigned int clusterVisibilityCount = 0;
+	};
+}
@@ -0,0 +1,59 @@
+#include "RangeAllocator.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace AB;
+
+unsigned int RangeAllocator::Allocate(unsigned int count)
+{
+	if (!count)
+		return end;
+
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+	{
+		if (it->count < count)
+			continue;
+		unsigned int first = it->first;
+		it->first += count;
+		it->count -= count;
+		if (!it->count)
+			freeRanges.erase(it);
+		return first;
+	}
+
+	unsigned int first = end;
+	end += count;
+	return first;
+}
+
+void RangeAllocator::Free(unsigned int first, unsigned int count)
+{
+	if (!count)
+		return;
+
+	// merge the range with the free ones on either side of it
+	auto range = lower_bound(freeRanges.begin(), freeRanges.end(), first,
+		[](const Range& free, unsigned int slot) { return free.first < slot; });
+	if (range != freeRanges.begin() && prev(range)->first + prev(range)->count == first)
+	{
+		range = prev(range);
+		range->count += count;
+	}
+	else
+	{
+		range = freeRanges.insert(range, { first, count });
+	}
+	auto after = range + 1;
+	if (after != freeRanges.end() && range->first + range->count == after->first)
+	{
+		range->count += after->count;
+		freeRanges.erase(after);
+	}
+
+	if (freeRanges.back().first + freeRanges.back().count == end)
+	{
+		end = freeRanges.back().first;
+		freeRanges.pop_back();
+	}
+}
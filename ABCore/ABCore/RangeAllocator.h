@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+namespace AB
+{
+	// Hands out runs of consecutive slots (vertices, indices, meshlets, ids...) of a buffer that only grows, and takes
+	// them back for reuse. Freed runs are kept merged with their neighbours, and ones at the end shrink GetEnd() again.
+	class RangeAllocator
+	{
+	public:
+
+		// the first of count consecutive slots: the first freed run they fit in, or else new ones at the end
+		unsigned int Allocate(unsigned int count);
+		void Free(unsigned int first, unsigned int count);
+
+		// one past the last slot in use; the buffer needs at least this many
+		unsigned int GetEnd() const { return end; }
+
+	private:
+
+		struct Range
+		{
+			unsigned int first;
+			unsigned int count;
+		};
+
+		// sorted by first, with no two touching, and none running up to end
+		std::vector<Range> freeRanges;
+		unsigned int end = 0;
+	};
+}
@@ -0,0 +1,587 @@
+#include "RenderQueue.h"
+#include "RenderState.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Shader.h"
+#include "OcclusionCuller.h"
+#include "Meshlet.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+
+using namespace std;
+using namespace AB;
+
+// Sort key layout, most significant first:
+//   opaque:      [program:12][texture set:16][vertex format:1][mesh:15][depth:20]
+//   transparent: [inverted depth:20][program:12][texture set:16][vertex format:1][mesh:15]
+// Every mesh of a vertex format shares its GeometryArena's VAO, so the format and mesh take the place of the VAO
+// and keep copies of a mesh, and then meshes a multi-draw can cover, together. Each LOD of a mesh gets its own mesh id.
+// GL names and ids are small, so masking them to their bits only merges keys in very large scenes,
+// which costs some batching but never changes what is drawn.
+#define PROGRAM_BITS 12
+#define TEXTURE_SET_BITS 16
+#define VERTEX_FORMAT_BITS 1
+#define MESH_BITS 15
+#define DEPTH_BITS 20
+
+// a run needs at least this many copies of a mesh to be drawn instanced when multi-draw-indirect is off
+#define MIN_INSTANCE_COUNT 2
+
+static uint64_t Bits(uint64_t value, int bits)
+{
+	return value & ((1ull << bits) - 1);
+}
+
+void RenderQueue::Clear()
+{
+	opaque.clear();
+	transparent.clear();
+	textureSets.clear();
+	meshIds.clear();
+
+	// forget the fades of draws that weren't submitted since the last clear
+	for (auto it = lodFades.begin(); it != lodFades.end();)
+	{
+		if (!it->second.submitted)
+		{
+			it = lodFades.erase(it);
+			continue;
+		}
+		it->second.submitted = false;
+		++it;
+	}
+
+	// and the cluster ids of draws that weren't clustered since the last clear
+	for (auto it = clusterIds.begin(); it != clusterIds.end();)
+	{
+		if (!it->second.submitted)
+		{
+			clusterIdRanges.Free(it->second.first, it->second.count);
+			it = clusterIds.erase(it);
+			continue;
+		}
+		it->second.submitted = false;
+		++it;
+	}
+}
+
+unsigned int RenderQueue::GetTextureSet(const Mesh& mesh)
+{
+	// FNV-1a over the GL texture ids, in the order they are bound, so two meshes only share a set when they
+	// bind the same GL textures to the same units (same-named textures loaded separately stay apart)
+	uint64_t hash = 14695981039346656037ull;
+	for (const Texture& texture : mesh.textures)
+	{
+		hash ^= texture.id;
+		hash *= 1099511628211ull;
+	}
+
+	auto it = textureSets.find(hash);
+	if (it != textureSets.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)textureSets.size();
+	textureSets[hash] = id;
+	return id;
+}
+
+unsigned int RenderQueue::GetMeshId(const Mesh* mesh, unsigned int lod)
+{
+	auto key = make_pair(mesh, lod);
+	auto it = meshIds.find(key);
+	if (it != meshIds.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)meshIds.size();
+	meshIds[key] = id;
+	return id;
+}
+
+unsigned int RenderQueue::SelectLOD(const Mesh& mesh, const glm::mat4& world, const glm::mat4& view) const
+{
+	if (mesh.bounds.IsEmpty())
+		return 0;
+
+	// distance along the view direction to the front of the mesh's bounding sphere
+	float scale = max(glm::length(glm::vec3(world[0])), max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+	glm::vec4 center = world * glm::vec4(mesh.bounds.GetCenter(), 1.f);
+	float distance = -(view * center).z - glm::length(mesh.bounds.GetExtents()) * scale;
+
+	// the camera is inside the bounds, or right at them
+	if (distance <= 0.f)
+		return 0;
+	return mesh.SelectLOD(lodScale * scale / distance, lodPixelError);
+}
+
+bool RenderQueue::UpdateLODFade(unsigned int drawId, const Mesh& mesh, unsigned int lod, unsigned int& previousLod, float& fade)
+{
+	LODFade& state = lodFades[drawId];
+	if (state.mesh != &mesh)
+	{
+		// a new draw, or one that draws another mesh now: there's nothing to fade from
+		state.mesh = &mesh;
+		state.lod = lod;
+		state.framesLeft = 0;
+	}
+	else if (state.lod != lod)
+	{
+		// a change in the middle of a fade starts over from the LOD it was fading to
+		state.previousLod = state.lod;
+		state.lod = lod;
+		state.framesLeft = lodFadeFrames;
+	}
+	state.submitted = true;
+
+	if (!state.framesLeft)
+		return false;
+
+	previousLod = state.previousLod;
+	fade = 1.f - (float)state.framesLeft / (lodFadeFrames + 1);
+	state.framesLeft--;
+	return true;
+}
+
+void RenderQueue::Submit(Shader& shader, Mesh& mesh, const Material& material, const glm::mat4& world, const glm::mat4& view, unsigned int drawId)
+{
+	DrawItem item;
+	item.shader = &shader;
+	item.mesh = &mesh;
+	item.material = &material;
+	item.world = world;
+	item.textureSet = GetTextureSet(mesh);
+	item.drawId = drawId;
+	item.lod = 0;
+	item.lodFade = 0.f;
+
+	// distance along the view direction to the object's origin, quantized to the depth bits
+	float depth = -(view * world[3]).z;
+	depth = glm::clamp(depth / maxDepth, 0.f, 1.f);
+	uint64_t depthBits = (uint64_t)(depth * ((1ull << DEPTH_BITS) - 1));
+
+	if (lodScale > 0.f && mesh.GetLODCount() > 1)
+	{
+		item.lod = SelectLOD(mesh, world, view);
+
+		unsigned int previousLod;
+		float fade;
+		if (lodFadeFrames && drawId != ~0u && UpdateLODFade(drawId, mesh, item.lod, previousLod, fade))
+		{
+			// both LODs, each dithered out of the pixels the other one covers
+			item.shader = &shader.Variant({ "USE_LOD_FADE" });
+			item.lodFade = fade;
+			Add(item, depthBits);
+
+			// the outgoing LOD is drawn untested: sharing the drawId, the two would race on its visibility slot
+			item.lod = previousLod;
+			item.lodFade = -fade;
+			item.drawId = ~0u;
+			Add(item, depthBits);
+			return;
+		}
+	}
+
+	Add(item, depthBits);
+}
+
+void RenderQueue::Add(DrawItem& item, uint64_t depthBits)
+{
+	uint64_t state = Bits(item.shader->ID, PROGRAM_BITS) << (TEXTURE_SET_BITS + VERTEX_FORMAT_BITS + MESH_BITS);
+	state |= Bits(item.textureSet, TEXTURE_SET_BITS) << (VERTEX_FORMAT_BITS + MESH_BITS);
+	state |= Bits(item.mesh->GetVertexFormat(), VERTEX_FORMAT_BITS) << MESH_BITS;
+	state |= Bits(GetMeshId(item.mesh, item.lod), MESH_BITS);
+
+	if (item.material->transmissive > 0.f)
+	{
+		uint64_t backToFront = ((1ull << DEPTH_BITS) - 1) - depthBits;
+		item.key = (backToFront << (PROGRAM_BITS + TEXTURE_SET_BITS + VERTEX_FORMAT_BITS + MESH_BITS)) | state;
+		transparent.push_back(item);
+	}
+	else
+	{
+		item.key = (state << DEPTH_BITS) | depthBits;
+		opaque.push_back(item);
+	}
+}
+
+// points the instance attribute of every arena at buffer (see GeometryArena::SetInstanceIndexBuffer)
+static void SetInstanceIndexBuffer(unsigned int buffer)
+{
+	for (int format = 0; format < VERTEX_FORMAT_COUNT; format++)
+		GeometryArena::Get((VertexFormat)format).SetInstanceIndexBuffer(buffer);
+}
+
+// the shader's instanced variant, or null if its sources don't support USE_INSTANCING
+static Shader* GetInstancedShader(Shader& shader)
+{
+	Shader& variant = shader.Variant({ "USE_INSTANCING" });
+	return variant.HasInstanceData() ? &variant : nullptr;
+}
+
+void RenderQueue::BuildBatches(const vector<DrawItem>& items)
+{
+	unsigned int minInstances = multiDrawIndirect ? 1 : MIN_INSTANCE_COUNT;
+
+	size_t i = 0;
+	while (i < items.size())
+	{
+		// sorting put the copies of a mesh's LOD next to each other
+		size_t end = i + 1;
+		while (end < items.size() && items[end].mesh == items[i].mesh && items[end].lod == items[i].lod && items[end].shader == items[i].shader)
+			end++;
+
+		Shader* instancedShader = end - i >= minInstances ? GetInstancedShader(*items[i].shader) : nullptr;
+		if (instancedShader)
+		{
+			const GeometryRange& geometry = items[i].mesh->GetGeometry(items[i].lod);
+			const PositionDecode& decode = items[i].mesh->GetPositionDecode();
+			DrawCommand command = { geometry.indexCount, (unsigned int)(end - i), geometry.firstIndex, geometry.baseVertex, (unsigned int)instances.size() };
+			DrawBatch batch = { &items[i], instancedShader, command.baseInstance, command.instanceCount, (unsigned int)commands.size(), false, 0 };
+			batches.push_back(batch);
+			commands.push_back(command);
+
+			for (size_t j = i; j < end; j++)
+			{
+				InstanceData instance;
+				instance.world = items[j].world;
+				instance.albedo = items[j].material->albedo;
+				instance.metallic = items[j].material->metallic;
+				instance.emissive = items[j].material->emissive;
+				instance.roughness = items[j].material->roughness;
+				instance.positionOffset = glm::vec3(decode.offset);
+				instance.lodFade = items[j].lodFade;
+				instance.positionScale = decode.scale;
+				instances.push_back(instance);
+			}
+		}
+		else
+		{
+			for (size_t j = i; j < end; j++)
+			{
+				DrawBatch batch = { &items[j], items[j].shader, 0, 0, 0, false, 0 };
+				batches.push_back(batch);
+			}
+		}
+		i = end;
+	}
+}
+
+size_t RenderQueue::Prepare()
+{
+	auto byKey = [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; };
+	sort(opaque.begin(), opaque.end(), byKey);
+	sort(transparent.begin(), transparent.end(), byKey);
+
+	batches.clear();
+	instances.clear();
+	commands.clear();
+	drawCalls = 0;
+	BuildBatches(opaque);
+	size_t opaqueBatches = batches.size();
+	BuildBatches(transparent);
+
+	// every instanced draw this frame reads from one upload
+	if (!instances.empty())
+	{
+		if (!instanceBuffer.ID)
+			instanceBuffer = StorageBuffer((unsigned int)(instances.size() * sizeof(InstanceData)), INSTANCE_DATA_BINDING);
+		instanceBuffer.Upload(instances.data(), (unsigned int)(instances.size() * sizeof(InstanceData)));
+		for (int format = 0; format < VERTEX_FORMAT_COUNT; format++)
+			GeometryArena::Get((VertexFormat)format).ReserveInstances((unsigned int)instances.size());
+	}
+	return opaqueBatches;
+}
+
+void RenderQueue::Draw(int drawMode)
+{
+	size_t opaqueBatches = Prepare();
+
+	if (multiDrawIndirect && !commands.empty())
+	{
+		if (!commandBuffer.ID)
+			commandBuffer = StorageBuffer((unsigned int)(commands.size() * sizeof(DrawCommand)), DRAW_COMMAND_BINDING);
+		commandBuffer.Upload(commands.data(), (unsigned int)(commands.size() * sizeof(DrawCommand)));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.ID);
+	}
+
+	DrawBatches(0, opaqueBatches, drawMode);
+	DrawTransparent(opaqueBatches, drawMode);
+
+	if (multiDrawIndirect && !commands.empty())
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void RenderQueue::Draw(OcclusionCuller& occlusionCuller, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, int drawMode)
+{
+	if (!multiDrawIndirect || !occlusionCuller.IsReady())
+	{
+		Draw(drawMode);
+		return;
+	}
+
+	size_t opaqueBatches = Prepare();
+
+	for (size_t i = 0; i < opaqueBatches; i++)
+	{
+		DrawBatch& batch = batches[i];
+		batch.clustered = clusterCulling && batch.instanceCount && batch.item->lod == 0 && batch.item->mesh->GetMeshletCount();
+	}
+
+	// the bounds of the opaque instances, which come first in the instance buffer
+	instanceBounds.clear();
+	unsigned int drawIdCount = 0;
+	for (size_t i = 0; i < opaqueBatches; i++)
+	{
+		const DrawBatch& batch = batches[i];
+		for (unsigned int j = 0; j < batch.instanceCount; j++)
+		{
+			const DrawItem& item = batch.item[j];
+			AABB box = item.mesh->bounds.Transform(item.world);
+
+			InstanceBounds bounds;
+			bounds.min = box.min;
+			bounds.max = box.max;
+			// the cluster pass culls the instances of clustered batches
+			bounds.command = batch.clustered ? ~0u : batch.command;
+			bounds.drawId = box.IsEmpty() ? ~0u : item.drawId;
+			instanceBounds.push_back(bounds);
+
+			if (bounds.drawId != ~0u)
+				drawIdCount = max(drawIdCount, bounds.drawId + 1);
+		}
+	}
+
+	// the commands as built, for the transparent draws, then a copy for each phase for the culling to fill in.
+	// Phase 2 writes its visible instances after phase 1's; only the opaque instances are culled, and the visible
+	// instance buffer only has room for two of those ranges.
+	unsigned int commandCount = (unsigned int)commands.size();
+	for (unsigned int phase = 1; phase <= 2; phase++)
+	{
+		for (unsigned int i = 0; i < commandCount; i++)
+		{
+			DrawCommand command = commands[i];
+			command.instanceCount = 0;
+			if (phase == 2)
+				command.baseInstance += (unsigned int)instanceBounds.size();
+			commands.push_back(command);
+		}
+	}
+	BuildClusters(opaqueBatches);
+
+	if (!commandBuffer.ID)
+		commandBuffer = StorageBuffer((unsigned int)(commands.size() * sizeof(DrawCommand)), DRAW_COMMAND_BINDING);
+	commandBuffer.Upload(commands.data(), (unsigned int)(commands.size() * sizeof(DrawCommand)));
+	commandBuffer.Bind();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.ID);
+
+	occlusionCuller.Upload(instanceBounds, drawIdCount);
+	occlusionCuller.UploadClusters(clusterItems, clusterBatches, clusterIdRanges.GetEnd());
+	unsigned int clusterBatchCount = (unsigned int)clusterBatches.size() / 2;
+
+	// phase 1: what was visible last frame
+	occlusionCuller.Cull(1, commandCount, viewProjection);
+	occlusionCuller.CullClusters(1, 0, viewProjection, cameraPosition);
+	SetInstanceIndexBuffer(occlusionCuller.GetVisibleInstanceBuffer());
+	DrawBatches(0, opaqueBatches, drawMode, commandCount);
+	// cluster commands name their instance directly
+	SetInstanceIndexBuffer(0);
+	DrawClusters(opaqueBatches, 1, occlusionCuller);
+
+	// phase 2: everything else that isn't hidden behind what phase 1 drew
+	occlusionCuller.BuildHiZ();
+	occlusionCuller.Cull(2, 2 * commandCount, viewProjection);
+	occlusionCuller.CullClusters(2, clusterBatchCount, viewProjection, cameraPosition);
+	SetInstanceIndexBuffer(occlusionCuller.GetVisibleInstanceBuffer());
+	DrawBatches(0, opaqueBatches, drawMode, 2 * commandCount, true);
+	SetInstanceIndexBuffer(0);
+	DrawClusters(opaqueBatches, 2, occlusionCuller);
+
+	DrawTransparent(opaqueBatches, drawMode);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+unsigned int RenderQueue::GetClusterIds(unsigned int drawId, const Mesh& mesh)
+{
+	ClusterIds& ids = clusterIds[drawId];
+	ids.submitted = true;
+	if (ids.mesh == &mesh && ids.count == mesh.GetMeshletCount())
+		return ids.first;
+
+	clusterIdRanges.Free(ids.first, ids.count);
+	ids.mesh = &mesh;
+	ids.count = mesh.GetMeshletCount();
+	ids.first = clusterIdRanges.Allocate(ids.count);
+	return ids.first;
+}
+
+void RenderQueue::BuildClusters(size_t opaqueBatches)
+{
+	clusterItems.clear();
+	clusterBatches.clear();
+	clusterFirstItems.clear();
+
+	for (size_t i = 0; i < opaqueBatches; i++)
+	{
+		DrawBatch& batch = batches[i];
+		if (!batch.clustered)
+			continue;
+
+		batch.clusterBatch = (unsigned int)clusterFirstItems.size();
+		clusterFirstItems.push_back((unsigned int)clusterItems.size());
+
+		const Mesh& mesh = *batch.item->mesh;
+		for (unsigned int j = 0; j < batch.instanceCount; j++)
+		{
+			unsigned int drawId = batch.item[j].drawId;
+			unsigned int firstId = drawId == ~0u ? ~0u : GetClusterIds(drawId, mesh);
+			for (unsigned int m = 0; m < mesh.GetMeshletCount(); m++)
+			{
+				ClusterItem item;
+				item.instance = batch.instanceOffset + j;
+				item.meshlet = mesh.GetFirstMeshlet() + m;
+				item.clusterId = firstId == ~0u ? ~0u : firstId + m;
+				item.batch = batch.clusterBatch;
+				clusterItems.push_back(item);
+			}
+		}
+	}
+	clusterFirstItems.push_back((unsigned int)clusterItems.size());
+
+	// every item gets a command slot in each phase, after everything else in the command buffer.
+	// They're uploaded zeroed, so drawing a batch's whole range draws nothing past its visible meshlets.
+	unsigned int firstCommand = (unsigned int)commands.size();
+	unsigned int itemCount = (unsigned int)clusterItems.size();
+	commands.resize(commands.size() + 2 * itemCount, DrawCommand());
+	for (unsigned int phase = 0; phase < 2; phase++)
+	{
+		for (size_t b = 0; b + 1 < clusterFirstItems.size(); b++)
+		{
+			ClusterBatch batch = { 0, firstCommand + phase * itemCount + clusterFirstItems[b] };
+			clusterBatches.push_back(batch);
+		}
+	}
+}
+
+void RenderQueue::DrawClusters(size_t end, int phase, OcclusionCuller& occlusionCuller)
+{
+	unsigned int clusterBatchCount = (unsigned int)clusterFirstItems.size() - 1;
+	if (!clusterBatchCount)
+		return;
+
+	if (GLEW_ARB_indirect_parameters)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, occlusionCuller.GetClusterBatchBuffer());
+
+	Shader* lastShader = nullptr;
+	for (size_t i = 0; i < end; i++)
+	{
+		const DrawBatch& batch = batches[i];
+		if (!batch.clustered)
+			continue;
+
+		if (batch.shader != lastShader)
+		{
+			batch.shader->use();
+			lastShader = batch.shader;
+		}
+		drawCalls++;
+
+		Mesh& mesh = *batch.item->mesh;
+		mesh.BindTextures(*batch.shader);
+		GeometryArena& arena = GeometryArena::Get(mesh.GetVertexFormat());
+		RenderState::Get().BindVertexArray(arena.GetVAO());
+
+		unsigned int clusterBatch = (phase - 1) * clusterBatchCount + batch.clusterBatch;
+		unsigned int maxCount = clusterFirstItems[batch.clusterBatch + 1] - clusterFirstItems[batch.clusterBatch];
+		const void* indirect = (const void*)(clusterBatches[clusterBatch].firstCommand * sizeof(DrawCommand));
+		if (GLEW_ARB_indirect_parameters)
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, arena.GetIndexType(), indirect, clusterBatch * sizeof(ClusterBatch), (int)maxCount, 0);
+		else
+			glMultiDrawElementsIndirect(GL_TRIANGLES, arena.GetIndexType(), indirect, (int)maxCount, 0);
+	}
+
+	if (GLEW_ARB_indirect_parameters)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+}
+
+void RenderQueue::DrawTransparent(size_t begin, int drawMode)
+{
+	if (begin == batches.size())
+		return;
+
+	RenderState& state = RenderState::Get();
+	state.SetBlend(true);
+	state.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.SetDepthWrite(false);
+
+	DrawBatches(begin, batches.size(), drawMode);
+
+	state.SetDepthWrite(true);
+	state.SetBlend(false);
+}
+
+void RenderQueue::DrawBatches(size_t begin, size_t end, int drawMode, unsigned int commandOffset, bool instancedOnly)
+{
+	Shader* lastShader = nullptr;
+	const Material* lastMaterial = nullptr;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const DrawBatch& batch = batches[i];
+		const DrawItem& item = *batch.item;
+		Shader& shader = *batch.shader;
+		const StandardUniforms& uniforms = shader.standard;
+
+		if (batch.clustered || (instancedOnly && !(batch.instanceCount && multiDrawIndirect)))
+			continue;
+
+		// uniforms belong to the program, so a new program needs the material set again
+		if (batch.shader != lastShader)
+		{
+			shader.use();
+			lastShader = batch.shader;
+			lastMaterial = nullptr;
+		}
+		drawCalls++;
+
+		if (batch.instanceCount && multiDrawIndirect)
+		{
+			// the following batches with the same program, textures and vertex format have consecutive commands;
+			// draw them all at once
+			VertexFormat format = item.mesh->GetVertexFormat();
+			size_t last = i + 1;
+			while (last < end && batches[last].instanceCount && !batches[last].clustered && batches[last].shader == batch.shader &&
+				batches[last].item->textureSet == item.textureSet && batches[last].item->mesh->GetVertexFormat() == format)
+				last++;
+
+			item.mesh->BindTextures(shader);
+			GeometryArena& arena = GeometryArena::Get(format);
+			RenderState::Get().BindVertexArray(arena.GetVAO());
+			glMultiDrawElementsIndirect(GL_TRIANGLES, arena.GetIndexType(), (const void*)((commandOffset + batch.command) * sizeof(DrawCommand)), (int)(last - i), 0);
+
+			i = last - 1;
+			continue;
+		}
+
+		if (batch.instanceCount)
+		{
+			item.mesh->Draw(shader, drawMode, (int)batch.instanceCount, batch.instanceOffset, item.lod);
+			continue;
+		}
+
+		shader.SetMatrix4x4(uniforms.world, item.world);
+		shader.SetFloat(uniforms.lodFade, item.lodFade);
+
+		if (item.material != lastMaterial)
+		{
+			const Material& material = *item.material;
+			shader.SetVector3(uniforms.albedoColor, material.albedo);
+			shader.SetFloat(uniforms.metallic, material.metallic);
+			shader.SetFloat(uniforms.roughness, material.roughness);
+			shader.SetVector3(uniforms.emissive, material.emissive);
+			lastMaterial = item.material;
+		}
+
+		item.mesh->Draw(shader, drawMode, 1, 0, item.lod);
+	}
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "UniformBuffer.h"
+#include "GeometryArena.h"
+#include "RangeAllocator.h"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <utility>
+
+namespace AB
+{
+	class Shader;
+	class Mesh;
+	class Material;
+	class OcclusionCuller;
+
+	struct DrawItem
+	{
+		uint64_t key;
+		Shader* shader;
+		Mesh* mesh;
+		const Material* material;
+		glm::mat4 world;
+		unsigned int textureSet;
+		unsigned int drawId;
+		unsigned int lod;
+		// see include/lod_fade.glsl; 0 when not cross-fading
+		float lodFade;
+	};
+
+	// Collects the draws of a frame and submits them sorted so that the fewest state changes happen between them.
+	// Opaque draws are sorted by program, then texture set, then mesh, then front-to-back.
+	// Transparent draws (materials with transmissive > 0) are drawn after them back-to-front, with blending on.
+	// Runs of the same mesh with the same shader become one instanced draw through the shader's USE_INSTANCING
+	// variant, which reads world matrices and material params from the InstanceData buffer.
+	//
+	// With multiDrawIndirect on, every draw of a shader that supports instancing goes through the instance buffer,
+	// and consecutive draws that share a program, texture set and vertex format are submitted with one
+	// glMultiDrawElementsIndirect over that format's GeometryArena.
+	//
+	// Drawn with an OcclusionCuller, those multi-draws are culled on the GPU in two phases (see OcclusionCuller.h).
+	// With clusterCulling on, instanced runs of meshes with meshlets are culled per meshlet instead and drawn with one
+	// command per visible meshlet, so only the parts of a large mesh like terrain that can be seen are rasterized.
+	//
+	// Meshes with LODs are drawn at the coarsest LOD whose error covers at most lodPixelError pixels on screen.
+	// With lodFadeFrames set, a draw that changes LOD cross-fades from the old one to the new one over that many frames,
+	// drawing both dithered through the shader's USE_LOD_FADE variant.
+	class RenderQueue
+	{
+	public:
+
+		RenderQueue() = default;
+
+		// forgets last frame's draws; call before submitting a new frame
+		void Clear();
+
+		// view is the camera's view matrix, used for the depth part of the sort key.
+		// drawId identifies the draw across frames for occlusion culling; ~0u draws it without testing.
+		void Submit(Shader& shader, Mesh& mesh, const Material& material, const glm::mat4& world, const glm::mat4& view, unsigned int drawId = ~0u);
+
+		// sorts and draws everything that was submitted
+		void Draw(int drawMode = 0x0004);
+		// same as above, but the opaque multi-draws are occlusion culled; viewProjection is the camera's projection * view
+		void Draw(OcclusionCuller& occlusionCuller, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, int drawMode = 0x0004);
+
+		size_t Size() const { return opaque.size() + transparent.size(); }
+
+		// draw calls issued by the last Draw, counting a multi-draw as one
+		unsigned int GetDrawCalls() const { return drawCalls; }
+
+		// the commands of the last Draw's multi-draws; DRAW_COMMAND_BINDING when used as a storage buffer
+		StorageBuffer& GetCommandBuffer() { return commandBuffer; }
+
+		// view depth that maps to the end of the key's depth range; anything further sorts as if it were here
+		float maxDepth = 1000.f;
+
+		bool multiDrawIndirect = true;
+		// cull meshes with meshlets per meshlet when drawing with an OcclusionCuller (LOD 0 only, which has the meshlets)
+		bool clusterCulling = true;
+
+		// pixels one unit covers at distance 1 on screen: projection[1][1] * viewport height / 2. 0 always draws LOD 0.
+		// Scene::Render sets it from its projection.
+		float lodScale = 0.f;
+		float lodPixelError = 1.f;
+		// frames a change of LOD takes to cross-fade, for draws with a drawId; 0 switches at once
+		unsigned int lodFadeFrames = 0;
+
+	private:
+
+		// one draw: a single item, or instanceCount instances starting at instanceOffset (with its indirect command).
+		// Clustered batches are drawn from the commands of their ClusterBatch instead.
+		struct DrawBatch
+		{
+			const DrawItem* item;
+			Shader* shader;
+			unsigned int instanceOffset;
+			unsigned int instanceCount;
+			unsigned int command;
+			bool clustered;
+			unsigned int clusterBatch;
+		};
+
+		// the clusterIds of a draw's meshlets, clusterIds[drawId].first onwards
+		struct ClusterIds
+		{
+			const Mesh* mesh = nullptr;
+			unsigned int first = 0;
+			unsigned int count = 0;
+			bool submitted = false;
+		};
+
+		// where a draw is in its cross-fade between LODs, if it is in one
+		struct LODFade
+		{
+			const Mesh* mesh = nullptr;
+			unsigned int lod = 0;
+			unsigned int previousLod = 0;
+			unsigned int framesLeft = 0;
+			bool submitted = false;
+		};
+
+		struct MeshLODHash
+		{
+			size_t operator()(const std::pair<const Mesh*, unsigned int>& key) const
+			{
+				return std::hash<const Mesh*>()(key.first) ^ (key.second * 0x9e3779b9u);
+			}
+		};
+
+		// gives the item its key and queues it
+		void Add(DrawItem& item, uint64_t depthBits);
+		unsigned int SelectLOD(const Mesh& mesh, const glm::mat4& world, const glm::mat4& view) const;
+		// tracks the draw's LOD changes; true while it's cross-fading from previousLod, fade of the way there
+		bool UpdateLODFade(unsigned int drawId, const Mesh& mesh, unsigned int lod, unsigned int& previousLod, float& fade);
+		// sorts the items, builds the batches and uploads the instances; returns the number of opaque batches
+		size_t Prepare();
+		void BuildBatches(const std::vector<DrawItem>& items);
+		// commandOffset is added to the batches' commands; instancedOnly skips everything that isn't a multi-draw
+		void DrawBatches(size_t begin, size_t end, int drawMode, unsigned int commandOffset = 0, bool instancedOnly = false);
+		void DrawTransparent(size_t begin, int drawMode);
+		// builds the cluster culling pass's items and batches from the opaque batches that can be clustered, and
+		// appends room for both phases' commands
+		void BuildClusters(size_t opaqueBatches);
+		// draws the clustered batches' commands of a phase
+		void DrawClusters(size_t end, int phase, OcclusionCuller& occlusionCuller);
+		unsigned int GetClusterIds(unsigned int drawId, const Mesh& mesh);
+		unsigned int GetTextureSet(const Mesh& mesh);
+		unsigned int GetMeshId(const Mesh* mesh, unsigned int lod);
+
+		std::vector<DrawItem> opaque;
+		std::vector<DrawItem> transparent;
+
+		// small ids for every distinct combination of textures, and every LOD of a mesh, submitted this frame
+		std::unordered_map<uint64_t, unsigned int> textureSets;
+		std::unordered_map<std::pair<const Mesh*, unsigned int>, unsigned int, MeshLODHash> meshIds;
+		// by drawId
+		std::unordered_map<unsigned int, LODFade> lodFades;
+		// by drawId. The ids of draws that stop being submitted, or that draw another mesh, go back to be reused, so
+		// a draw that gets new ones may start out with another draw's visibility; the second phase corrects it.
+		std::unordered_map<unsigned int, ClusterIds> clusterIds;
+		RangeAllocator clusterIdRanges;
+
+		std::vector<DrawBatch> batches;
+		std::vector<InstanceData> instances;
+		std::vector<DrawCommand> commands;
+		// per instance, for occlusion culling
+		std::vector<InstanceBounds> instanceBounds;
+		// per meshlet of a clustered instance, and per clustered batch and phase, for cluster culling
+		std::vector<ClusterItem> clusterItems;
+		std::vector<ClusterBatch> clusterBatches;
+		// each clustered batch's first item, and one past the last batch's items
+		std::vector<unsigned int> clusterFirstItems;
+		StorageBuffer instanceBuffer;
+		StorageBuffer commandBuffer;
+		unsigned int drawCalls = 0;
+	};
+}
@@ -0,0 +1,179 @@
+#include "RenderState.h"
+
+#include <GL/glew.h>
+
+using namespace AB;
+
+RenderState* RenderState::instance;
+
+static const unsigned int UNKNOWN = ~0u;
+static const long long UNKNOWN_UNIFORM_VALUE = 1LL << 32;
+
+bool RenderState::Changed(unsigned int& tracked, unsigned int value)
+{
+	if (tracked == value)
+	{
+		current.avoidedCalls++;
+		return false;
+	}
+	tracked = value;
+	current.issuedCalls++;
+	return true;
+}
+
+void RenderState::UseProgram(unsigned int value)
+{
+	if (Changed(program, value))
+		glUseProgram(value);
+}
+
+void RenderState::BindVertexArray(unsigned int vao)
+{
+	if (Changed(vertexArray, vao))
+		glBindVertexArray(vao);
+}
+
+void RenderState::BindTexture(unsigned int unit, unsigned int texture, unsigned int target)
+{
+	if (unit >= MAX_TEXTURE_UNITS)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		activeUnit = UNKNOWN;
+		current.issuedCalls += 2;
+		return;
+	}
+
+	// the unit is made active even when the texture is already bound, since callers go on to edit the texture
+	if (Changed(activeUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+
+	// a unit keeps one binding per target, so only the last target bound through here is known
+	if (textureTargets[unit] != target)
+	{
+		textureTargets[unit] = target;
+		textures[unit] = UNKNOWN;
+	}
+	if (textures[unit] == texture)
+	{
+		current.avoidedCalls++;
+		return;
+	}
+
+	textures[unit] = texture;
+	current.issuedCalls++;
+	glBindTexture(target, texture);
+}
+
+void RenderState::BindFramebuffer(unsigned int value)
+{
+	if (Changed(framebuffer, value))
+		glBindFramebuffer(GL_FRAMEBUFFER, value);
+}
+
+void RenderState::SetCapability(int& tracked, unsigned int cap, bool enabled)
+{
+	if (tracked == (int)enabled)
+	{
+		current.avoidedCalls++;
+		return;
+	}
+	tracked = (int)enabled;
+	current.issuedCalls++;
+	if (enabled)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+void RenderState::SetDepthTest(bool enabled)
+{
+	SetCapability(depthTest, GL_DEPTH_TEST, enabled);
+}
+
+void RenderState::SetCullFace(bool enabled)
+{
+	SetCapability(cullFace, GL_CULL_FACE, enabled);
+}
+
+void RenderState::SetBlend(bool enabled)
+{
+	SetCapability(blend, GL_BLEND, enabled);
+}
+
+void RenderState::SetDepthWrite(bool enabled)
+{
+	if (depthWrite == (int)enabled)
+	{
+		current.avoidedCalls++;
+		return;
+	}
+	depthWrite = (int)enabled;
+	current.issuedCalls++;
+	glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void RenderState::SetBlendFunc(unsigned int src, unsigned int dst)
+{
+	if (blendSrc == src && blendDst == dst)
+	{
+		current.avoidedCalls++;
+		return;
+	}
+	blendSrc = src;
+	blendDst = dst;
+	current.issuedCalls++;
+	glBlendFunc(src, dst);
+}
+
+void RenderState::Invalidate()
+{
+	program = vertexArray = framebuffer = activeUnit = UNKNOWN;
+	blendSrc = blendDst = UNKNOWN;
+	depthTest = cullFace = blend = depthWrite = -1;
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		textures[i] = UNKNOWN;
+		textureTargets[i] = UNKNOWN;
+	}
+	intUniforms.clear();
+}
+
+void RenderState::OnTextureDeleted(unsigned int texture)
+{
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		if (textures[i] == texture)
+			textures[i] = UNKNOWN;
+}
+
+void RenderState::OnVertexArrayDeleted(unsigned int vao)
+{
+	if (vertexArray == vao)
+		vertexArray = UNKNOWN;
+}
+
+void RenderState::OnProgramLinked(unsigned int program)
+{
+	intUniforms.erase(program);
+}
+
+bool RenderState::UniformIntChanged(unsigned int program, int location, int value)
+{
+	std::vector<long long>& values = intUniforms[program];
+	if (location >= (int)values.size())
+		values.resize(location + 1, UNKNOWN_UNIFORM_VALUE);
+	if (values[location] == value)
+	{
+		current.avoidedCalls++;
+		return false;
+	}
+	values[location] = value;
+	current.issuedCalls++;
+	return true;
+}
+
+void RenderState::BeginFrame()
+{
+	lastFrame = current;
+	current = RenderStats();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+namespace AB
+{
+	struct RenderStats
+	{
+		unsigned int issuedCalls = 0;
+		unsigned int avoidedCalls = 0;
+	};
+
+	// Shadows the GL state that changes between draws (program, VAO, texture units, framebuffer,
+	// depth/cull/blend) and skips any call that would set it to what is already bound.
+	// Everything that binds these has to go through here, otherwise the shadow copy goes stale;
+	// after raw GL calls that may have touched them, call Invalidate().
+	class RenderState
+	{
+	public:
+
+		static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+		static RenderState& Get()
+		{
+			if (!instance)
+				instance = new RenderState();
+			return *instance;
+		}
+
+		void UseProgram(unsigned int program);
+		void BindVertexArray(unsigned int vao);
+		// binds the texture to the given unit, leaving that unit active. target defaults to GL_TEXTURE_2D
+		void BindTexture(unsigned int unit, unsigned int texture, unsigned int target = 0x0DE1);
+		void BindFramebuffer(unsigned int framebuffer);
+
+		void SetDepthTest(bool enabled);
+		void SetCullFace(bool enabled);
+		void SetBlend(bool enabled);
+		void SetDepthWrite(bool enabled);
+		void SetBlendFunc(unsigned int src, unsigned int dst);
+
+		// forgets everything that is tracked, so the next call of each kind goes through to GL
+		void Invalidate();
+		// a deleted object's name can be reused by GL, so it must not stay recorded as bound
+		void OnTextureDeleted(unsigned int texture);
+		void OnVertexArrayDeleted(unsigned int vao);
+		// linking (again) resets a program's uniforms, and deleting it lets GL reuse its name
+		void OnProgramLinked(unsigned int program);
+
+		// records value as set for the int/bool/sampler uniform at location of program, and returns false (counting
+		// an avoided call) when it was already set to it. Uniform values belong to the program, so they are tracked
+		// by program name: they survive switching programs and are shared by every Shader copy using the program
+		bool UniformIntChanged(unsigned int program, int location, int value);
+
+		// call once at the start of every frame; GetLastFrameStats then reports the frame before
+		void BeginFrame();
+		const RenderStats& GetLastFrameStats() const { return lastFrame; }
+
+		RenderState(RenderState const&) = delete;
+		void operator=(RenderState const&) = delete;
+
+	private:
+
+		static RenderState* instance;
+
+		RenderState() { Invalidate(); };
+
+		bool Changed(unsigned int& tracked, unsigned int value);
+		void SetCapability(int& tracked, unsigned int cap, bool enabled);
+
+		// ~0u (and -1 for capabilities) means unknown
+		unsigned int program;
+		unsigned int vertexArray;
+		unsigned int framebuffer;
+		unsigned int activeUnit;
+		unsigned int textures[MAX_TEXTURE_UNITS];
+		unsigned int textureTargets[MAX_TEXTURE_UNITS];
+		unsigned int blendSrc, blendDst;
+		int depthTest, cullFace, blend, depthWrite;
+		// last value set by location, per program; values outside the range of int are unknown
+		std::unordered_map<unsigned int, std::vector<long long>> intUniforms;
+
+		RenderStats current;
+		RenderStats lastFrame;
+	};
+}
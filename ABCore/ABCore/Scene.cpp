@@ -1,4 +1,7 @@
 #include "Scene.h"
+#include "OcclusionCuller.h"
+
+#include <GL/glew.h>
 
 #include <iostream>
 
@@ -56,6 +59,12 @@ GameObject* Scene::Add(GameObject&& obj)
 	return &gameobjects.back();
 }
 
+void Scene::ReplaceMesh(const shared_ptr<Mesh>& mesh, const vector<shared_ptr<Mesh>>& replacement)
+{
+	for (auto& obj : gameobjects)
+		obj.ReplaceMesh(mesh, replacement);
+}
+
 vector<GameObject>& Scene::GetAllObjects()
 {
 	return gameobjects;
@@ -151,8 +160,9 @@ bool Scene::RaycastInternal(glm::vec3 origin, glm::vec3 dir, RaycastHit* hit, gl
 	// loop through all tri's in scene (every 3 indices)
 	for (GameObject& obj : gameobjects)
 	{
-		for (Mesh& m : obj.GetMeshes())
+		for (auto& mesh : obj.GetMeshes())
 		{
+			Mesh& m = *mesh;
 			switch (m.type)
 			{
 			case MESH_TRI:
@@ -280,10 +290,53 @@ bool Scene::RaycastTreeInternal(KDNode* node, glm::vec3 origin, glm::vec3 dir, R
 
 void Scene::Render(Shader& shader)
 {
+	// without a camera there's no telling how big anything is on screen
+	renderQueue.lodScale = 0.f;
+	renderQueue.Clear();
 	for (auto& obj : gameobjects)
 	{
-		obj.Draw(shader);
+		glm::mat4 world = obj.GetWorldTM().GetMatrix();
+		for (auto& mesh : obj.GetMeshes())
+			renderQueue.Submit(shader, *mesh, obj.GetMaterial(), world, glm::mat4());
 	}
+	renderQueue.Draw();
+
+	cullingStats = CullingStats();
+	cullingStats.visible = (unsigned int)gameobjects.size();
+}
+
+void Scene::Render(Shader& shader, const glm::mat4& view, const glm::mat4& projection)
+{
+	culler.Clear();
+	for (auto& obj : gameobjects)
+		culler.Add(obj.GetWorldBounds());
+	cullingStats = culler.Cull(Frustum(projection * view), visible);
+
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	renderQueue.lodScale = projection[1][1] * viewport[3] * 0.5f;
+
+	renderQueue.Clear();
+	// every mesh of every object gets the same draw id each frame, whether it's in the frustum or not
+	unsigned int drawId = 0;
+	for (size_t i = 0; i < gameobjects.size(); i++)
+	{
+		GameObject& obj = gameobjects[i];
+		if (!visible[i])
+		{
+			drawId += (unsigned int)obj.GetMeshes().size();
+			continue;
+		}
+
+		glm::mat4 world = obj.GetWorldTM().GetMatrix();
+		for (auto& mesh : obj.GetMeshes())
+			renderQueue.Submit(shader, *mesh, obj.GetMaterial(), world, view, drawId++);
+	}
+
+	if (occlusionCuller)
+		renderQueue.Draw(*occlusionCuller, projection * view, glm::vec3(glm::inverse(view)[3]));
+	else
+		renderQueue.Draw();
 }
 
 void Scene::CreateTree(int maxDepth)
@@ -294,9 +347,9 @@ void Scene::CreateTree(int maxDepth)
 	{
 		for (auto& mesh : obj.GetMeshes())
 		{
-			for (unsigned int& i : mesh.indices)
+			for (unsigned int& i : mesh->indices)
 				allIndices.push_back({ &obj, i + allVerts.size() });
-			for (Vertex& v : mesh.vertices)
+			for (Vertex& v : mesh->vertices)
 				allVerts.push_back(&v);
 		}
 	}
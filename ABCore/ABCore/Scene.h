@@ -2,10 +2,12 @@
 
 #include <vector>
 #include "GameObject.h"
+#include "RenderQueue.h"
 
 namespace AB
 {
 	struct KDNode;
+	class OcclusionCuller;
 
 	struct RaycastHit
 	{
@@ -39,6 +41,9 @@ namespace AB
 		// Finds a particular game object by its name.
 		GameObject* Find(std::string objName);
 
+		// Puts replacement in place of mesh in every game object that has it, e.g. a placeholder once the model has loaded.
+		void ReplaceMesh(const std::shared_ptr<Mesh>& mesh, const std::vector<std::shared_ptr<Mesh>>& replacement);
+
 		// Creates the KD tree from the vertex info
 		// MAKE SURE ALL VERTS ARE IN WORLD SPACE BEFORE INVOKING THIS
 		void CreateTree(int depth);
@@ -47,8 +52,20 @@ namespace AB
 		// MAKE SURE ALL VERTS ARE IN WORLD SPACE BEFORE INVOKING THIS
 		bool Raycast(glm::vec3 origin, glm::vec3 dir, RaycastHit* hit = nullptr, float maxDistance = 99999999.f);
 
-		// Draws all objects in the scene via rasterization.
+		// Draws all objects in the scene via rasterization, sorted to minimize state changes.
 		void Render(Shader& shader);
+		// Same as above, but only the objects whose world bounds touch the camera's view frustum.
+		// view also decides the front-to-back order, and projection and the viewport which LOD meshes are drawn at.
+		// With an occlusion culler set, objects hidden behind others are culled on the GPU as well.
+		void Render(Shader& shader, const glm::mat4& view, const glm::mat4& projection);
+
+		// null turns occlusion culling off. The culler must have the depth buffer the scene is rendered into.
+		void SetOcclusionCuller(OcclusionCuller* occlusionCuller) { this->occlusionCuller = occlusionCuller; }
+
+		// visible and culled object counts of the last Render
+		const CullingStats& GetCullingStats() const { return cullingStats; }
+
+		RenderQueue& GetRenderQueue() { return renderQueue; }
 
 		~Scene();
 
@@ -61,6 +78,11 @@ namespace AB
 		bool RaycastTreeInternal(KDNode* node, glm::vec3 origin, glm::vec3 dir, RaycastHit* hit, glm::vec3& resultUVW, Vertex (&hitTri)[3], bool& front);
 
 		std::vector<GameObject> gameobjects;
+		RenderQueue renderQueue;
+		FrustumCuller culler;
+		std::vector<unsigned char> visible;
+		CullingStats cullingStats;
+		OcclusionCuller* occlusionCuller = nullptr;
 		KDNode* root;
 		std::vector<Vertex*> allVerts;
 	};
@@ -1,4 +1,6 @@
 #include "Shader.h"
+#include "UniformBuffer.h"
+#include "RenderState.h"
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -7,140 +9,244 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MAKE_DIRECTORY(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MAKE_DIRECTORY(path) mkdir(path, 0755)
+#endif
 
 using namespace std;
 using namespace AB;
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
-{
-	string vertexCode;
-	string fragmentCode;
-	ifstream vShaderFile;
-	ifstream fShaderFile;
-
-	// set ifstream objects to throw exceptions
-	vShaderFile.exceptions(ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(ifstream::failbit | std::ifstream::badbit);
-
-	try
-	{
-		// open files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		stringstream vShaderStream, fShaderStream;
-
-		// read file's buffer contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-
-		// close file handlers
-		fShaderFile.close();
-		vShaderFile.close();
-
-		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-	}
-	catch (ifstream::failure e)
-	{
-		cout << "ERROR: Shader file was not successfully read. " << std::endl;
-	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
-
-	// compile shaders
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
-    
-    // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-
-    // Check compilation errors
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success)
+// linked programs are stored here as driver binaries, named by the hash of their sources
+#define SHADER_CACHE_DIRECTORY "ShaderCache"
+
+// reads a whole shader file into code
+static void ReadShaderFile(const char* path, string& code)
+{
+    ifstream file;
+    // set ifstream objects to throw exceptions
+    file.exceptions(ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+        file.open(path);
+        stringstream stream;
+        stream << file.rdbuf();
+        file.close();
+        code = stream.str();
+    }
+    catch (ifstream::failure e)
     {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        cout << "SHADER COMPILATIN ERROR: VERTEX COMPILATION FAILED;\n" << infoLog << endl;
+        cout << "ERROR: Shader file was not successfully read. " << std::endl;
     }
+}
 
-    // fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
+// FNV-1a, continuing from hash
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
-    // Check compilation errors
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success)
+static const char* StageName(unsigned int type)
+{
+    switch (type)
     {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        cout << "SHADER COMPILATIN ERROR: FRAGMENT COMPILATION FAILED;\n" << infoLog << endl;
+    case GL_VERTEX_SHADER: return "VERTEX";
+    case GL_FRAGMENT_SHADER: return "FRAGMENT";
+    case GL_COMPUTE_SHADER: return "COMPUTE";
+    default: return "UNKNOWN";
     }
+}
 
-    // Create shader program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
+// Reads path into out, replacing each #include "file" with the (preprocessed) contents of that file.
+// Every file is only included once. #line directives keep compile errors pointing at the right line;
+// the source-string number of an error is the index of the file in included.
+static void ResolveIncludes(const string& path, vector<string>& included, string& out)
+{
+    string code;
+    ReadShaderFile(path.c_str(), code);
+    int fileIndex = (int)included.size();
+    included.push_back(path);
 
-    // Check link errors
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
-    if (!success)
+    string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    stringstream lines(code);
+    string line;
+    int lineNumber = 0;
+    while (getline(lines, line))
     {
-        glGetProgramInfoLog(ID, 512, NULL, infoLog);
-        cout << "SHADER LINK ERROR: \n" << infoLog << endl;
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line.compare(start, 8, "#include") != 0)
+        {
+            out += line + "\n";
+            continue;
+        }
+
+        size_t open = line.find('"', start);
+        size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+        if (close == string::npos)
+        {
+            cout << "ERROR: Malformed #include in " << path << " line " << lineNumber << endl;
+            continue;
+        }
+
+        string includePath = directory + line.substr(open + 1, close - open - 1);
+        if (find(included.begin(), included.end(), includePath) == included.end())
+        {
+            out += "#line 1 " + to_string(included.size()) + "\n";
+            ResolveIncludes(includePath, included, out);
+        }
+        out += "#line " + to_string(lineNumber + 1) + " " + to_string(fileIndex) + "\n";
     }
+}
 
-    // once linked, shaders are no longer needed
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+// Resolves includes, then inserts the defines right after #version (which has to stay the first line)
+static string PreprocessShader(const string& path, const vector<string>& defines)
+{
+    vector<string> included;
+    string code;
+    ResolveIncludes(path, included, code);
+
+    // the light array size always comes from the C++ side so the LightData block layouts match
+    string defineBlock = "#define MAX_LIGHT_COUNT " + to_string(MAX_LIGHT_COUNT) + "\n";
+    for (const string& define : defines)
+    {
+        size_t equals = define.find('=');
+        if (equals == string::npos)
+            defineBlock += "#define " + define + "\n";
+        else
+            defineBlock += "#define " + define.substr(0, equals) + " " + define.substr(equals + 1) + "\n";
+    }
+
+    size_t version = code.find("#version");
+    size_t insertAt = version == string::npos ? 0 : code.find('\n', version) + 1;
+    int versionLine = (int)count(code.begin(), code.begin() + insertAt, '\n');
+    code.insert(insertAt, defineBlock + "#line " + to_string(versionLine + 1) + " 0\n");
+    return code;
 }
 
-Shader::Shader(const char* computePath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const vector<string>& defines)
+    : sourcePaths({ vertexPath, fragmentPath }), defines(defines)
 {
-    string computeCode;
-    ifstream cShaderFile;
+    Build({ { GL_VERTEX_SHADER, PreprocessShader(vertexPath, defines) },
+            { GL_FRAGMENT_SHADER, PreprocessShader(fragmentPath, defines) } });
+}
 
-    cShaderFile.exceptions(ifstream::failbit | std::ifstream::badbit);
-    try
+Shader::Shader(const char* computePath, const vector<string>& defines)
+    : sourcePaths({ computePath }), defines(defines)
+{
+    Build({ { GL_COMPUTE_SHADER, PreprocessShader(computePath, defines) } });
+}
+
+Shader& Shader::Variant(const vector<string>& extraDefines)
+{
+    if (extraDefines.empty())
+        return *this;
+
+    // the same set of defines in any order is the same permutation
+    vector<string> allDefines = defines;
+    allDefines.insert(allDefines.end(), extraDefines.begin(), extraDefines.end());
+    sort(allDefines.begin(), allDefines.end());
+    allDefines.erase(unique(allDefines.begin(), allDefines.end()), allDefines.end());
+
+    string key;
+    for (const string& define : allDefines)
+        key += define + ";";
+
+    shared_ptr<Shader>& variant = variants[key];
+    if (!variant)
     {
-        cShaderFile.open(computePath);
+        if (sourcePaths.size() == 2)
+            variant = make_shared<Shader>(sourcePaths[0].c_str(), sourcePaths[1].c_str(), allDefines);
+        else if (sourcePaths.size() == 1)
+            variant = make_shared<Shader>(sourcePaths[0].c_str(), allDefines);
+        else
+        {
+            cout << "ERROR: Shader has no sources to build a variant from" << endl;
+            return *this;
+        }
+    }
+    return *variant;
+}
 
-        stringstream cShaderStream;
-        cShaderStream << cShaderFile.rdbuf();
-        cShaderFile.close();
+void Shader::Build(const vector<ShaderStage>& stages)
+{
+    auto start = chrono::steady_clock::now();
 
-        computeCode = cShaderStream.str();
+    // the same sources give a different binary on a different driver, so the driver is part of the key
+    uint64_t key = HashBytes(NULL, 0);
+    const GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : driverStrings)
+    {
+        const char* str = (const char*)glGetString(name);
+        if (str) key = HashBytes(str, strlen(str), key);
     }
-    catch (ifstream::failure e)
+    for (const ShaderStage& stage : stages)
     {
-        cout << "ERROR: Shader file was not successfully read. " << std::endl;
+        key = HashBytes(&stage.type, sizeof(stage.type), key);
+        key = HashBytes(stage.source.data(), stage.source.size(), key);
     }
-    const char* cShaderCode = computeCode.c_str();
 
-    // compile shaders
-    unsigned int compute;
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)key);
+    string cachePath = string(SHADER_CACHE_DIRECTORY) + "/" + fileName;
+
+    bool cached = LoadProgramBinary(cachePath);
+    if (!cached)
+    {
+        CompileAndLink(stages);
+        SaveProgramBinary(cachePath);
+    }
+
+    BuildUniformTable();
+    BindUniformBlocks();
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Shader program " << (cached ? "loaded from binary cache" : "compiled from source") << " in " << ms << "ms" << endl;
+}
+
+void Shader::CompileAndLink(const vector<ShaderStage>& stages)
+{
     int success;
     char infoLog[512];
 
-    // vertex shader
-    compute = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(compute, 1, &cShaderCode, NULL);
-    glCompileShader(compute);
-
-    // Check compilation errors
-    glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
-    if (!success)
+    // compile shaders
+    vector<unsigned int> shaders;
+    for (const ShaderStage& stage : stages)
     {
-        glGetShaderInfoLog(compute, 512, NULL, infoLog);
-        cout << "SHADER COMPILATIN ERROR: COMPUTE COMPILATION FAILED;\n" << infoLog << endl;
+        const char* code = stage.source.c_str();
+        unsigned int shader = glCreateShader(stage.type);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+
+        // Check compilation errors
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            cout << "SHADER COMPILATIN ERROR: " << StageName(stage.type) << " COMPILATION FAILED;\n" << infoLog << endl;
+        }
+        shaders.push_back(shader);
     }
 
     // Create shader program
     ID = glCreateProgram();
-    glAttachShader(ID, compute);
+    for (unsigned int shader : shaders)
+        glAttachShader(ID, shader);
+    // ask the driver to keep the binary around so it can be cached
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);
 
     // Check link errors
@@ -150,43 +256,227 @@ Shader::Shader(const char* computePath)
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
         cout << "SHADER LINK ERROR: \n" << infoLog << endl;
     }
-    glDeleteShader(compute);
+
+    // once linked, shaders are no longer needed
+    for (unsigned int shader : shaders)
+        glDeleteShader(shader);
+}
+
+bool Shader::LoadProgramBinary(const string& path)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    GLenum format = 0;
+    file.read((char*)&format, sizeof(format));
+    vector<char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (binary.empty())
+        return false;
+
+    ID = glCreateProgram();
+    glProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
+
+    // drivers reject binaries from other versions or hardware; recompile from source in that case
+    int success;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        cout << "Shader binary " << path << " was rejected by the driver, compiling from source" << endl;
+        glDeleteProgram(ID);
+        ID = 0;
+        return false;
+    }
+    return true;
+}
+
+void Shader::SaveProgramBinary(const string& path)
+{
+    int success, length = 0, formatCount = 0;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!success || formatCount == 0 || length <= 0)
+        return; // nothing (valid) to cache
+
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(ID, length, NULL, &format, binary.data());
+
+    MAKE_DIRECTORY(SHADER_CACHE_DIRECTORY);
+    ofstream file(path, ios::binary);
+    if (!file.is_open())
+    {
+        cout << "ERROR: Could not write shader binary " << path << endl;
+        return;
+    }
+    file.write((const char*)&format, sizeof(format));
+    file.write(binary.data(), binary.size());
 }
 
 void Shader::use()
 {
-    glUseProgram(ID);
+    RenderState::Get().UseProgram(ID);
+}
+
+void Shader::BuildUniformTable()
+{
+    uniformLocations.clear();
+    RenderState::Get().OnProgramLinked(ID);
+
+    int count = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+    const GLenum props[3] = { GL_NAME_LENGTH, GL_ARRAY_SIZE, GL_LOCATION };
+    for (int i = 0; i < count; i++)
+    {
+        int values[3];
+        glGetProgramResourceiv(ID, GL_UNIFORM, i, 3, props, 3, NULL, values);
+        if (values[2] < 0) continue; // members of uniform blocks have no location
+
+        string name(values[0], '\0');
+        glGetProgramResourceName(ID, GL_UNIFORM, i, values[0], NULL, &name[0]);
+        name.resize(values[0] - 1); // length includes the null terminator
+        uniformLocations[name] = values[2];
+
+        // arrays are only reported by their first element, so add the bare name and the other elements too.
+        // Element locations aren't guaranteed to follow on from the first one, so each is queried by name
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        {
+            string base = name.substr(0, name.size() - 3);
+            uniformLocations[base] = values[2];
+            for (int e = 1; e < values[1]; e++)
+            {
+                string element = base + "[" + to_string(e) + "]";
+                int location = glGetProgramResourceLocation(ID, GL_UNIFORM, element.c_str());
+                if (location >= 0)
+                    uniformLocations[element] = location;
+            }
+        }
+    }
+
+    standard.world = GetUniform("world");
+    standard.view = GetUniform("view");
+    standard.projection = GetUniform("projection");
+    standard.albedoColor = GetUniform("albedoColor");
+    standard.metallic = GetUniform("metallic");
+    standard.roughness = GetUniform("roughness");
+    standard.emissive = GetUniform("emissive");
+    standard.positionOffset = GetUniform("positionOffset");
+    standard.positionScale = GetUniform("positionScale");
+    standard.lodFade = GetUniform("lodFade");
+    standard.useDiffuseTex = GetUniform("useDiffuseTex");
+    for (int i = 0; i < StandardUniforms::MAX_TEXTURES; i++)
+    {
+        standard.diffuseTextures[i] = GetUniform("texture_diffuse[" + to_string(i) + "]");
+        standard.specularTextures[i] = GetUniform("texture_specular[" + to_string(i) + "]");
+    }
+}
+
+void Shader::BindUniformBlocks()
+{
+    unsigned int frameBlock = glGetUniformBlockIndex(ID, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, frameBlock, FRAME_DATA_BINDING);
+
+    unsigned int lightBlock = glGetUniformBlockIndex(ID, "LightData");
+    if (lightBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, lightBlock, LIGHT_DATA_BINDING);
+
+    static const struct { const char* name; unsigned int binding; } storageBlocks[] =
+    {
+        { "InstanceData", INSTANCE_DATA_BINDING },
+        { "DrawCommands", DRAW_COMMAND_BINDING },
+        { "InstanceBounds", INSTANCE_BOUNDS_BINDING },
+        { "VisibleInstances", VISIBLE_INSTANCE_BINDING },
+        { "DrawVisibility", DRAW_VISIBILITY_BINDING },
+        { "Meshlets", MESHLET_BINDING },
+        { "ClusterItems", CLUSTER_ITEM_BINDING },
+        { "ClusterBatches", CLUSTER_BATCH_BINDING }
+    };
+    for (const auto& block : storageBlocks)
+    {
+        unsigned int index = glGetProgramResourceIndex(ID, GL_SHADER_STORAGE_BLOCK, block.name);
+        if (index != GL_INVALID_INDEX)
+            glShaderStorageBlockBinding(ID, index, block.binding);
+    }
+    hasInstanceData = glGetProgramResourceIndex(ID, GL_SHADER_STORAGE_BLOCK, "InstanceData") != GL_INVALID_INDEX;
+}
+
+UniformHandle Shader::GetUniform(const string& name) const
+{
+    UniformHandle handle;
+    auto it = uniformLocations.find(name);
+    if (it != uniformLocations.end())
+        handle.location = it->second;
+    return handle;
 }
 
 void Shader::SetBool(const string& name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    SetInt(GetUniform(name), (int)value);
 }
 void Shader::SetInt(const string& name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    SetInt(GetUniform(name), value);
 }
 void Shader::SetUint(const std::string& name, unsigned int value) const
 {
-    glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1ui(GetUniform(name).location, value);
 }
 void Shader::SetFloat(const string& name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(GetUniform(name).location, value);
 }
 void Shader::SetVector2(const string& name, glm::vec2 value) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), value.x, value.y);
+    glUniform2f(GetUniform(name).location, value.x, value.y);
 }
 void Shader::SetVector3(const string& name, glm::vec3 value) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+    glUniform3f(GetUniform(name).location, value.x, value.y, value.z);
 }
 void Shader::SetVector4(const string& name, glm::vec4 value) const
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z, value.w);
+    glUniform4f(GetUniform(name).location, value.x, value.y, value.z, value.w);
 }
 void Shader::SetMatrix4x4(const string& name, glm::mat4x4 value) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
-}
\ No newline at end of file
+    glUniformMatrix4fv(GetUniform(name).location, 1, GL_FALSE, glm::value_ptr(value));
+}
+void Shader::SetBool(UniformHandle handle, bool value) const
+{
+    SetInt(handle, (int)value);
+}
+void Shader::SetInt(UniformHandle handle, int value) const
+{
+    if (!handle.IsValid()) return;
+
+    // flags and samplers are mostly set to the value they already have
+    if (RenderState::Get().UniformIntChanged(ID, handle.location, value))
+        glUniform1i(handle.location, value);
+}
+void Shader::SetUint(UniformHandle handle, unsigned int value) const
+{
+    glUniform1ui(handle.location, value);
+}
+void Shader::SetFloat(UniformHandle handle, float value) const
+{
+    glUniform1f(handle.location, value);
+}
+void Shader::SetVector2(UniformHandle handle, glm::vec2 value) const
+{
+    glUniform2f(handle.location, value.x, value.y);
+}
+void Shader::SetVector3(UniformHandle handle, glm::vec3 value) const
+{
+    glUniform3f(handle.location, value.x, value.y, value.z);
+}
+void Shader::SetVector4(UniformHandle handle, glm::vec4 value) const
+{
+    glUniform4f(handle.location, value.x, value.y, value.z, value.w);
+}
+void Shader::SetMatrix4x4(UniformHandle handle, glm::mat4x4 value) const
+{
+    glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(value));
+}
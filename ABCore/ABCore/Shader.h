@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 
 namespace glm
 {
@@ -24,13 +27,53 @@ namespace glm
 
 namespace AB
 {
+    // Location of a uniform, looked up once from the shader's uniform table so draws can set it
+    // without any string work. A handle to a uniform the shader doesn't have is invalid and setting it does nothing.
+    struct UniformHandle
+    {
+        int location = -1;
+
+        bool IsValid() const { return location >= 0; }
+    };
+
+    // Handles to the uniforms that GameObject and Mesh set on every draw
+    struct StandardUniforms
+    {
+        static const int MAX_TEXTURES = 4;
+
+        UniformHandle world;
+        UniformHandle view;
+        UniformHandle projection;
+
+        UniformHandle albedoColor;
+        UniformHandle metallic;
+        UniformHandle roughness;
+        UniformHandle emissive;
+
+        // see include/vertex_format.glsl
+        UniformHandle positionOffset;
+        UniformHandle positionScale;
+        // see include/lod_fade.glsl
+        UniformHandle lodFade;
+
+        UniformHandle useDiffuseTex;
+        UniformHandle diffuseTextures[MAX_TEXTURES];
+        UniformHandle specularTextures[MAX_TEXTURES];
+    };
+
     class Shader
     {
     public:
-        // constructor to read and build the shader
+        // constructor to read and build the shader.
+        // Sources go through a preprocessor first: #include "file" is resolved relative to the including file,
+        // and each define ("USE_PBR" or "NAME=VALUE") is inserted after the #version line.
         Shader() = default;
-        Shader(const char* vertexPath, const char* fragmentPath);
-        Shader(const char* computePath);
+        Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = std::vector<std::string>());
+        Shader(const char* computePath, const std::vector<std::string>& defines = std::vector<std::string>());
+
+        // returns this shader built with extra defines. Each permutation is compiled the first time it's asked for,
+        // then reused.
+        Shader& Variant(const std::vector<std::string>& extraDefines);
 
         // use/activate the shader
         void use();
@@ -45,6 +88,49 @@ namespace AB
         void SetVector4(const std::string& name, glm::vec4 value) const;
         void SetMatrix4x4(const std::string& name, glm::mat4x4 value) const;
 
+        // looks up a uniform in the table built at link time. Arrays can be looked up by element ("lights[2].color").
+        UniformHandle GetUniform(const std::string& name) const;
+
+        // whether the program reads the InstanceData storage buffer (USE_INSTANCING variants of shaders that support it)
+        bool HasInstanceData() const { return hasInstanceData; }
+
+        // same as above, but through a handle from GetUniform; use these in per-draw code
+        void SetBool(UniformHandle handle, bool value) const;
+        void SetInt(UniformHandle handle, int value) const;
+        void SetUint(UniformHandle handle, unsigned int value) const;
+        void SetFloat(UniformHandle handle, float value) const;
+        void SetVector2(UniformHandle handle, glm::vec2 value) const;
+        void SetVector3(UniformHandle handle, glm::vec3 value) const;
+        void SetVector4(UniformHandle handle, glm::vec4 value) const;
+        void SetMatrix4x4(UniformHandle handle, glm::mat4x4 value) const;
+
         unsigned int ID;
+        StandardUniforms standard;
+
+    private:
+        struct ShaderStage
+        {
+            unsigned int type;
+            std::string source;
+        };
+
+        // links the program, from the binary cache if this exact program was linked before on this driver
+        void Build(const std::vector<ShaderStage>& stages);
+        void CompileAndLink(const std::vector<ShaderStage>& stages);
+        bool LoadProgramBinary(const std::string& path);
+        void SaveProgramBinary(const std::string& path);
+
+        // queries every active uniform of the linked program into uniformLocations
+        void BuildUniformTable();
+        // points the program's uniform and storage blocks (FrameData, InstanceData, ...) at the shared binding points (see UniformBuffer.h)
+        void BindUniformBlocks();
+
+        std::unordered_map<std::string, int> uniformLocations;
+        bool hasInstanceData = false;
+
+        // what this shader was built from, so permutations can be built later
+        std::vector<std::string> sourcePaths;
+        std::vector<std::string> defines;
+        std::unordered_map<std::string, std::shared_ptr<Shader>> variants;
     };
 }
\ No newline at end of file
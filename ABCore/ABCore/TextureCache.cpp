@@ -0,0 +1,162 @@
+#include "TextureCache.h"
+#include "RenderState.h"
+
+#include <GL/glew.h>
+#include <iostream>
+#include <vector>
+#include <cctype>
+#include <algorithm>
+
+using namespace std;
+using namespace AB;
+
+TextureCache* TextureCache::instance;
+
+TextureResource::~TextureResource()
+{
+	RenderState::Get().OnTextureDeleted(id);
+	glDeleteTextures(1, &id);
+	TextureCache::Get().textures.erase(key);
+}
+
+string TextureCache::CanonicalPath(const string& path)
+{
+	string normalized = path;
+	replace(normalized.begin(), normalized.end(), '\\', '/');
+#ifdef _WIN32
+	// paths aren't case sensitive here
+	transform(normalized.begin(), normalized.end(), normalized.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+#endif
+
+	bool absolute = !normalized.empty() && normalized[0] == '/';
+	vector<string> parts;
+	size_t start = 0;
+	while (start <= normalized.size())
+	{
+		size_t end = normalized.find('/', start);
+		if (end == string::npos)
+			end = normalized.size();
+
+		string part = normalized.substr(start, end - start);
+		if (part == "..")
+		{
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (!absolute)
+				parts.push_back(part);
+		}
+		else if (!part.empty() && part != ".")
+			parts.push_back(part);
+
+		start = end + 1;
+	}
+
+	string result = absolute ? "/" : "";
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		if (i) result += '/';
+		result += parts[i];
+	}
+	return result;
+}
+
+static string GetKey(const string& filename, const TextureSampler& sampler)
+{
+	return TextureCache::CanonicalPath(filename) + "|" + to_string(sampler.wrap) + "|" + to_string(sampler.minFilter) + "|" + to_string(sampler.magFilter);
+}
+
+Texture TextureCache::Acquire(const string& typeName, const string& path, const string& directory, const TextureSampler& sampler, bool& created)
+{
+	Texture texture;
+	texture.type = typeName;
+	texture.path = path;
+
+	string key = GetKey(directory + '/' + path, sampler);
+	auto it = textures.find(key);
+	if (it != textures.end())
+		texture.resource = it->second.lock();
+
+	created = !texture.resource;
+	if (created)
+	{
+		texture.resource = make_shared<TextureResource>();
+		texture.resource->key = key;
+		texture.resource->sampler = sampler;
+		glGenTextures(1, &texture.resource->id);
+		textures[key] = texture.resource;
+	}
+
+	texture.id = texture.resource->id;
+	return texture;
+}
+
+Texture TextureCache::Load(const string& typeName, const string& path, const string& directory, const TextureSampler& sampler)
+{
+	bool created;
+	Texture texture = Acquire(typeName, path, directory, sampler, created);
+	if (!created)
+		return texture;
+
+	TextureImage image;
+	if (LoadTextureImage(directory + '/' + path, typeName, compressTextures, image))
+	{
+		Upload(texture.id, image, sampler);
+	}
+	else
+	{
+		cout << "Texture failed to load at path: " << path << endl;
+		// dropping the only reference deletes the texture and forgets it, so the next Load tries again
+		texture.resource.reset();
+		texture.id = 0;
+	}
+
+	return texture;
+}
+
+void TextureCache::Upload(unsigned int id, const unsigned char* data, int width, int height, int components, const TextureSampler& sampler)
+{
+	GLenum format = 0;
+	if (components == 1)
+		format = GL_RED;
+	else if (components == 3)
+		format = GL_RGB;
+	else if (components == 4)
+		format = GL_RGBA;
+
+	RenderState::Get().BindTexture(0, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+}
+
+void TextureCache::Upload(unsigned int id, const TextureImage& image, const TextureSampler& sampler)
+{
+	if (image.levels.empty())
+		return;
+
+	if (image.format == TEXTURE_FORMAT_RAW)
+	{
+		const TextureLevel& level = image.levels[0];
+		Upload(id, level.data.data(), level.width, level.height, image.components, sampler);
+		return;
+	}
+
+	// the blocks go up as they are, mips included
+	RenderState::Get().BindTexture(0, id);
+	unsigned int internalFormat = GetCompressedInternalFormat(image.format);
+	for (size_t i = 0; i < image.levels.size(); i++)
+	{
+		const TextureLevel& level = image.levels[i];
+		glCompressedTexImage2D(GL_TEXTURE_2D, (int)i, internalFormat, level.width, level.height, 0, (int)level.data.size(), level.data.data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)image.levels.size() - 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include "Mesh.h"
+#include "TextureCompression.h"
+
+namespace AB
+{
+	// How a texture is sampled; part of the cache key, so the same image can be cached with different settings
+	struct TextureSampler
+	{
+		int wrap = 0x2901;          // GL_REPEAT
+		int minFilter = 0x2703;     // GL_LINEAR_MIPMAP_LINEAR
+		int magFilter = 0x2601;     // GL_LINEAR
+	};
+
+	// A GL texture owned by the TextureCache. Textures hold it through a shared_ptr, and the last one to let go
+	// deletes the GL texture and removes it from the cache.
+	struct TextureResource
+	{
+		unsigned int id = 0;
+		std::string key;
+		TextureSampler sampler;
+
+		~TextureResource();
+	};
+
+	// Singleton that makes sure every image is decoded and uploaded once per sampler setting.
+	// Textures are keyed by canonical path, so "./Assets//a.png" and "Assets/a.png" are the same texture.
+	// With compressTextures on, images are uploaded block-compressed with their mips from a .dds next to them,
+	// which is converted from the image the first time it's loaded (see TextureCompression.h).
+	class TextureCache
+	{
+	public:
+
+		static TextureCache& Get()
+		{
+			if (!instance)
+				instance = new TextureCache();
+			return *instance;
+		}
+
+		TextureCache(TextureCache const&) = delete;
+		void operator=(TextureCache const&) = delete;
+
+		// the texture of the image at directory/path, loaded the first time it's asked for. Its id is 0 if it failed to load.
+		Texture Load(const std::string& typeName, const std::string& path, const std::string& directory, const TextureSampler& sampler = TextureSampler());
+
+		// the cached texture, or a new empty one if there is none (created is set) for the caller to Upload to
+		Texture Acquire(const std::string& typeName, const std::string& path, const std::string& directory, const TextureSampler& sampler, bool& created);
+
+		// fills texture id with decoded image data (1, 3 or 4 8-bit components), mipmaps it and applies sampler
+		static void Upload(unsigned int id, const unsigned char* data, int width, int height, int components, const TextureSampler& sampler = TextureSampler());
+		// same as above for an image from LoadTextureImage; compressed images bring their own mips
+		static void Upload(unsigned int id, const TextureImage& image, const TextureSampler& sampler = TextureSampler());
+
+		// resolves "." and ".." and duplicate separators, and uses '/' throughout
+		static std::string CanonicalPath(const std::string& path);
+
+		// textures currently alive
+		size_t Size() const { return textures.size(); }
+
+		bool compressTextures = true;
+
+	private:
+
+		friend struct TextureResource;
+
+		static TextureCache* instance;
+		TextureCache() {};
+
+		std::unordered_map<std::string, std::weak_ptr<TextureResource>> textures;
+	};
+}
@@ -0,0 +1,473 @@
+#include "TextureCompression.h"
+
+#include <GL/glew.h>
+#include <stb_image.h>
+#include <glm/glm.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
+
+using namespace std;
+using namespace AB;
+
+//////////////////////////////////////////////////////////////////////
+//
+//	Block encoders. Every format works on 4x4 pixel blocks; blocks past the
+//	edge of an image repeat its last row and column.
+//
+//////////////////////////////////////////////////////////////////////
+
+// 4x4 pixels as RGBA
+typedef unsigned char Block[16][4];
+
+static void FetchBlock(const TextureLevel& level, int components, int blockX, int blockY, Block& block)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		for (int x = 0; x < 4; x++)
+		{
+			int px = min(blockX * 4 + x, level.width - 1);
+			int py = min(blockY * 4 + y, level.height - 1);
+			const unsigned char* pixel = &level.data[(py * level.width + px) * components];
+			unsigned char* out = block[y * 4 + x];
+
+			// one channel images go into red and green as well, so BC1 of a grayscale image stays gray
+			out[0] = pixel[0];
+			out[1] = components >= 2 ? pixel[1] : pixel[0];
+			out[2] = components >= 3 ? pixel[2] : pixel[0];
+			out[3] = components == 4 ? pixel[3] : 255;
+		}
+	}
+}
+
+static unsigned short PackRGB565(const glm::vec3& color)
+{
+	int r = (int)glm::clamp(color.r * 31.f / 255.f + 0.5f, 0.f, 31.f);
+	int g = (int)glm::clamp(color.g * 63.f / 255.f + 0.5f, 0.f, 63.f);
+	int b = (int)glm::clamp(color.b * 31.f / 255.f + 0.5f, 0.f, 31.f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static glm::vec3 UnpackRGB565(unsigned short color)
+{
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+// BC1 color block in four color mode: endpoints at the extremes of the colors along their principal axis
+static void EncodeBC1(const Block& block, unsigned char* out)
+{
+	glm::vec3 colors[16];
+	glm::vec3 mean(0.f), low(255.f), high(0.f);
+	for (int i = 0; i < 16; i++)
+	{
+		colors[i] = glm::vec3(block[i][0], block[i][1], block[i][2]);
+		mean += colors[i];
+		low = glm::min(low, colors[i]);
+		high = glm::max(high, colors[i]);
+	}
+	mean /= 16.f;
+
+	float covariance[6] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		glm::vec3 d = colors[i] - mean;
+		covariance[0] += d.r * d.r; covariance[1] += d.r * d.g; covariance[2] += d.r * d.b;
+		covariance[3] += d.g * d.g; covariance[4] += d.g * d.b; covariance[5] += d.b * d.b;
+	}
+
+	// a few rounds of power iteration, starting from the bounding box diagonal
+	glm::vec3 axis = high - low;
+	for (int i = 0; i < 4; i++)
+	{
+		axis = glm::vec3(
+			covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+			covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+			covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+		float length = glm::max(glm::max(glm::abs(axis.r), glm::abs(axis.g)), glm::abs(axis.b));
+		if (length < 1e-6f)
+			break;
+		axis /= length;
+	}
+
+	glm::vec3 start = low, end = high;
+	if (glm::dot(axis, axis) > 1e-6f)
+	{
+		float minT = FLT_MAX, maxT = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = glm::dot(colors[i] - mean, axis);
+			if (t < minT) { minT = t; start = colors[i]; }
+			if (t > maxT) { maxT = t; end = colors[i]; }
+		}
+	}
+
+	// pull the endpoints in a little; the extremes are rarely where the error is smallest
+	glm::vec3 inset = (end - start) / 16.f;
+	unsigned short c0 = PackRGB565(end - inset);
+	unsigned short c1 = PackRGB565(start + inset);
+	if (c0 < c1)
+		swap(c0, c1);
+
+	glm::vec3 palette[4];
+	palette[0] = UnpackRGB565(c0);
+	palette[1] = UnpackRGB565(c1);
+	palette[2] = (palette[0] * 2.f + palette[1]) / 3.f;
+	palette[3] = (palette[0] + palette[1] * 2.f) / 3.f;
+
+	unsigned int indices = 0;
+	if (c0 != c1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			float bestError = FLT_MAX;
+			for (int p = 0; p < 4; p++)
+			{
+				glm::vec3 d = colors[i] - palette[p];
+				float error = glm::dot(d, d);
+				if (error < bestError) { bestError = error; best = p; }
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+// BC4 block of one channel in eight value mode: max, min and six values between them
+static void EncodeBC4(const Block& block, int channel, unsigned char* out)
+{
+	int low = 255, high = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		low = min(low, (int)block[i][channel]);
+		high = max(high, (int)block[i][channel]);
+	}
+
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+
+	unsigned long long indices = 0;
+	if (high > low)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			// nearest of the 8 steps from low (0) to high (7); index 0 is high, 1 is low, 2 to 7 step down from high
+			int step = (int)((block[i][channel] - low) * 7.f / (high - low) + 0.5f);
+			unsigned long long index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+			indices |= index << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static int GetBlockSize(TextureFormat format)
+{
+	return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC4 ? 8 : 16;
+}
+
+static void CompressLevel(const TextureLevel& level, int components, TextureFormat format, TextureLevel& out)
+{
+	int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+	int blockSize = GetBlockSize(format);
+	out.width = level.width;
+	out.height = level.height;
+	out.data.resize(blocksX * blocksY * blockSize);
+
+	Block block;
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			FetchBlock(level, components, bx, by, block);
+			unsigned char* dest = &out.data[(by * blocksX + bx) * blockSize];
+			switch (format)
+			{
+			case TEXTURE_FORMAT_BC1: EncodeBC1(block, dest); break;
+			case TEXTURE_FORMAT_BC3: EncodeBC4(block, 3, dest); EncodeBC1(block, dest + 8); break;
+			case TEXTURE_FORMAT_BC4: EncodeBC4(block, 0, dest); break;
+			case TEXTURE_FORMAT_BC5: EncodeBC4(block, 0, dest); EncodeBC4(block, 1, dest + 8); break;
+			default: break;
+			}
+		}
+	}
+}
+
+// next mip level, each pixel the average of the 2x2 above it
+static TextureLevel Downsample(const TextureLevel& level, int components)
+{
+	TextureLevel next;
+	next.width = max(level.width / 2, 1);
+	next.height = max(level.height / 2, 1);
+	next.data.resize(next.width * next.height * components);
+
+	for (int y = 0; y < next.height; y++)
+	{
+		int y0 = min(y * 2, level.height - 1), y1 = min(y * 2 + 1, level.height - 1);
+		for (int x = 0; x < next.width; x++)
+		{
+			int x0 = min(x * 2, level.width - 1), x1 = min(x * 2 + 1, level.width - 1);
+			for (int c = 0; c < components; c++)
+			{
+				int sum = level.data[(y0 * level.width + x0) * components + c] + level.data[(y0 * level.width + x1) * components + c] +
+					level.data[(y1 * level.width + x0) * components + c] + level.data[(y1 * level.width + x1) * components + c];
+				next.data[(y * next.width + x) * components + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return next;
+}
+
+TextureFormat AB::ChooseTextureFormat(const unsigned char* pixels, int width, int height, int components, const string& typeName)
+{
+	if (typeName == "texture_normal" && components >= 2)
+		return TEXTURE_FORMAT_BC5;
+	if (components == 1)
+		return TEXTURE_FORMAT_BC4;
+	if (components == 4)
+	{
+		for (int i = 0; i < width * height; i++)
+		{
+			if (pixels[i * 4 + 3] != 255)
+				return TEXTURE_FORMAT_BC3;
+		}
+	}
+	return components == 2 ? TEXTURE_FORMAT_RAW : TEXTURE_FORMAT_BC1;
+}
+
+TextureImage AB::CompressImage(const unsigned char* pixels, int width, int height, int components, TextureFormat format)
+{
+	TextureImage image;
+	image.format = format;
+	image.components = components;
+
+	TextureLevel level;
+	level.width = width;
+	level.height = height;
+	level.data.assign(pixels, pixels + width * height * components);
+
+	while (true)
+	{
+		image.levels.emplace_back();
+		CompressLevel(level, components, format, image.levels.back());
+		if (level.width == 1 && level.height == 1)
+			break;
+		level = Downsample(level, components);
+	}
+	return image;
+}
+
+bool AB::IsTextureFormatSupported(TextureFormat format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_RAW: return true;
+	case TEXTURE_FORMAT_BC1:
+	case TEXTURE_FORMAT_BC3: return GLEW_EXT_texture_compression_s3tc != 0;
+	case TEXTURE_FORMAT_BC4:
+	case TEXTURE_FORMAT_BC5: return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+	}
+	return false;
+}
+
+unsigned int AB::GetCompressedInternalFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEXTURE_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TEXTURE_FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case TEXTURE_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return 0;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+//	DDS files
+//
+//////////////////////////////////////////////////////////////////////
+
+#define DDS_MAGIC 0x20534444        // "DDS "
+#define DDSD_REQUIRED 0x1007        // caps | height | width | pixel format
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
+#define FOURCC(a, b, c, d) ((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+
+struct DDSPixelFormat
+{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int fourCC;
+	unsigned int rgbBitCount;
+	unsigned int masks[4];
+};
+
+struct DDSHeader
+{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int height;
+	unsigned int width;
+	unsigned int pitchOrLinearSize;
+	unsigned int depth;
+	unsigned int mipMapCount;
+	unsigned int reserved1[11];
+	DDSPixelFormat pixelFormat;
+	unsigned int caps[4];
+	unsigned int reserved2;
+};
+
+static_assert(sizeof(DDSHeader) == 124, "DDSHeader must match the file layout");
+
+static const struct { TextureFormat format; unsigned int fourCC; } DDS_FORMATS[] =
+{
+	{ TEXTURE_FORMAT_BC1, FOURCC('D', 'X', 'T', '1') },
+	{ TEXTURE_FORMAT_BC3, FOURCC('D', 'X', 'T', '5') },
+	{ TEXTURE_FORMAT_BC4, FOURCC('A', 'T', 'I', '1') },
+	{ TEXTURE_FORMAT_BC5, FOURCC('A', 'T', 'I', '2') }
+};
+
+bool AB::SaveDDS(const string& path, const TextureImage& image)
+{
+	unsigned int fourCC = 0;
+	for (const auto& entry : DDS_FORMATS)
+	{
+		if (entry.format == image.format)
+			fourCC = entry.fourCC;
+	}
+	if (!fourCC || image.levels.empty())
+		return false;
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_REQUIRED | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.width = image.levels[0].width;
+	header.height = image.levels[0].height;
+	header.pitchOrLinearSize = (unsigned int)image.levels[0].data.size();
+	header.mipMapCount = (unsigned int)image.levels.size();
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = fourCC;
+	header.caps[0] = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+	ofstream file(path, ios::binary);
+	if (!file.is_open())
+	{
+		cout << "ERROR: Could not write compressed texture " << path << endl;
+		return false;
+	}
+
+	unsigned int magic = DDS_MAGIC;
+	file.write((const char*)&magic, sizeof(magic));
+	file.write((const char*)&header, sizeof(header));
+	for (const TextureLevel& level : image.levels)
+		file.write((const char*)level.data.data(), level.data.size());
+	return true;
+}
+
+bool AB::LoadDDS(const string& path, TextureImage& image)
+{
+	ifstream file(path, ios::binary);
+	if (!file.is_open())
+		return false;
+
+	unsigned int magic = 0;
+	DDSHeader header = {};
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&header, sizeof(header));
+	if (!file || magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC))
+		return false;
+
+	image = TextureImage();
+	for (const auto& entry : DDS_FORMATS)
+	{
+		if (entry.fourCC == header.pixelFormat.fourCC)
+			image.format = entry.format;
+	}
+	if (image.format == TEXTURE_FORMAT_RAW)
+	{
+		cout << "ERROR: " << path << " isn't BC1, BC3, BC4 or BC5" << endl;
+		return false;
+	}
+
+	int width = header.width, height = header.height;
+	unsigned int levelCount = header.flags & DDSD_MIPMAPCOUNT ? max(header.mipMapCount, 1u) : 1;
+	for (unsigned int i = 0; i < levelCount; i++)
+	{
+		TextureLevel level;
+		level.width = width;
+		level.height = height;
+		level.data.resize(((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(image.format));
+		file.read((char*)level.data.data(), level.data.size());
+		if (!file)
+		{
+			cout << "ERROR: " << path << " is truncated" << endl;
+			return false;
+		}
+		image.levels.push_back(move(level));
+
+		width = max(width / 2, 1);
+		height = max(height / 2, 1);
+	}
+	return true;
+}
+
+string AB::GetCompressedTexturePath(const string& imagePath)
+{
+	return imagePath + ".dds";
+}
+
+// whether path exists and was modified no earlier than source (or source doesn't exist)
+static bool IsUpToDate(const string& path, const string& source)
+{
+	struct stat converted, original;
+	if (stat(path.c_str(), &converted) != 0)
+		return false;
+	return stat(source.c_str(), &original) != 0 || converted.st_mtime >= original.st_mtime;
+}
+
+bool AB::LoadTextureImage(const string& path, const string& typeName, bool compress, TextureImage& image)
+{
+	string ddsPath = GetCompressedTexturePath(path);
+	if (compress && IsUpToDate(ddsPath, path) && LoadDDS(ddsPath, image) && IsTextureFormatSupported(image.format))
+		return true;
+
+	int width, height, components;
+	unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &components, 0);
+	if (!pixels)
+		return false;
+
+	TextureFormat format = compress ? ChooseTextureFormat(pixels, width, height, components, typeName) : TEXTURE_FORMAT_RAW;
+	if (format != TEXTURE_FORMAT_RAW && IsTextureFormatSupported(format))
+	{
+		image = CompressImage(pixels, width, height, components, format);
+		SaveDDS(ddsPath, image);
+	}
+	else
+	{
+		image = TextureImage();
+		image.components = components;
+		image.levels.emplace_back();
+		image.levels[0].width = width;
+		image.levels[0].height = height;
+		image.levels[0].data.assign(pixels, pixels + width * height * components);
+	}
+
+	stbi_image_free(pixels);
+	return true;
+}
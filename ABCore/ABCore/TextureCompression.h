@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace AB
+{
+	// Block-compressed formats textures can be converted to. BC1 for opaque color, BC3 for color with alpha,
+	// BC4 for single channel images and BC5 for normal maps (x and y only; z is rebuilt in the shader).
+	enum TextureFormat : int
+	{
+		TEXTURE_FORMAT_RAW,
+		TEXTURE_FORMAT_BC1,
+		TEXTURE_FORMAT_BC3,
+		TEXTURE_FORMAT_BC4,
+		TEXTURE_FORMAT_BC5
+	};
+
+	struct TextureLevel
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> data;
+	};
+
+	// An image ready to upload: 8-bit pixels in one level (GL generates the mips), or compressed blocks with every mip
+	struct TextureImage
+	{
+		TextureFormat format = TEXTURE_FORMAT_RAW;
+		int components = 0;
+		std::vector<TextureLevel> levels;
+	};
+
+	// picks the compressed format for an image: BC5 for "texture_normal", BC4 for one channel,
+	// BC3 if any pixel isn't fully opaque, otherwise BC1
+	TextureFormat ChooseTextureFormat(const unsigned char* pixels, int width, int height, int components, const std::string& typeName);
+
+	// builds the mip chain of the pixels (box filtered) and compresses every level to format
+	TextureImage CompressImage(const unsigned char* pixels, int width, int height, int components, TextureFormat format);
+
+	// whether the current GL context can sample format
+	bool IsTextureFormatSupported(TextureFormat format);
+
+	// GL internal format of a compressed format
+	unsigned int GetCompressedInternalFormat(TextureFormat format);
+
+	// .dds files with the legacy DXT1/DXT5/ATI1/ATI2 headers
+	bool SaveDDS(const std::string& path, const TextureImage& image);
+	bool LoadDDS(const std::string& path, TextureImage& image);
+
+	// path of the converted copy of an image
+	std::string GetCompressedTexturePath(const std::string& imagePath);
+
+	// reads the image at path ready to upload. If compress is on and the context supports it, that's its .dds
+	// (converted from the image and saved the first time, or again whenever the image is newer);
+	// otherwise the decoded pixels. Doesn't touch GL, so it can run on any thread.
+	bool LoadTextureImage(const std::string& path, const std::string& typeName, bool compress, TextureImage& image);
+}
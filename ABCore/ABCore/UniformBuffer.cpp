@@ -0,0 +1,83 @@
+#include "UniformBuffer.h"
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <algorithm>
+
+using namespace AB;
+using namespace std;
+
+static_assert(sizeof(Light) == 64, "Light must match the std140 layout of the shaders' Light struct");
+static_assert(sizeof(FrameData) == 144, "FrameData must match the std140 layout of the FrameData block");
+static_assert(sizeof(LightData) == 656, "LightData must match the std140 layout of the LightData block");
+static_assert(sizeof(InstanceData) == 128, "InstanceData must match the std430 layout of the shaders' Instance struct");
+static_assert(sizeof(InstanceBounds) == 32, "InstanceBounds must match the std430 layout of the culling shader's struct");
+static_assert(sizeof(ClusterItem) == 16, "ClusterItem must match the std430 layout of the cluster culling shader's struct");
+static_assert(sizeof(ClusterBatch) == 8, "ClusterBatch must match the std430 layout of the cluster culling shader's struct");
+
+UniformBuffer::UniformBuffer(unsigned int size, unsigned int binding) : size(size), binding(binding)
+{
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	Bind();
+}
+
+void UniformBuffer::Upload(const void* data, unsigned int dataSize, unsigned int offset)
+{
+	if (offset + dataSize > size)
+	{
+		cout << "ERROR: Uniform buffer upload of " << dataSize << " bytes doesn't fit in " << size << " bytes" << endl;
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, dataSize, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::Bind()
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+}
+
+StorageBuffer::StorageBuffer(unsigned int size, unsigned int binding) : size(size), binding(binding)
+{
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	Bind();
+}
+
+void StorageBuffer::Upload(const void* data, unsigned int dataSize)
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+	if (dataSize > size)
+	{
+		// grow geometrically so a slowly growing scene doesn't reallocate every frame
+		size = max(dataSize, size * 2);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, dataSize, data);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void StorageBuffer::Reserve(unsigned int dataSize)
+{
+	if (dataSize <= size)
+		return;
+
+	size = max(dataSize, size * 2);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void StorageBuffer::Bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ID);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace AB
+{
+	// must match MAX_LIGHT_COUNT in the shaders
+	const unsigned int MAX_LIGHT_COUNT = 10;
+
+	// Binding points shared by every Shader. Shaders that declare a block with one of these names
+	// get it bound to the matching point when they're linked.
+	enum UniformBlockBinding : unsigned int
+	{
+		FRAME_DATA_BINDING = 0,
+		LIGHT_DATA_BINDING = 1
+	};
+
+	// Binding points of the shader storage blocks, bound the same way as the uniform blocks above
+	enum StorageBlockBinding : unsigned int
+	{
+		INSTANCE_DATA_BINDING = 0,
+		DRAW_COMMAND_BINDING = 1,
+		INSTANCE_BOUNDS_BINDING = 2,
+		VISIBLE_INSTANCE_BINDING = 3,
+		DRAW_VISIBILITY_BINDING = 4,
+		MESHLET_BINDING = 5,
+		CLUSTER_ITEM_BINDING = 6,
+		CLUSTER_BATCH_BINDING = 7
+	};
+
+	enum LightType : int
+	{
+		LIGHT_TYPE_DIRECTIONAL,
+		LIGHT_TYPE_POINT,
+		LIGHT_TYPE_SPOT
+	};
+
+	// Laid out to match the shaders' Light struct under std140, where every vec3 starts on 16 bytes
+	struct Light
+	{
+		unsigned int Type;
+		float pad[3];
+		glm::vec3 Direction;
+		float Range;
+		glm::vec3 Position;
+		float Intensity;
+		glm::vec3 Color;
+		float SpotFalloff;
+	};
+
+	// std140 layout of "uniform FrameData"; uploaded once per frame (or per view)
+	struct FrameData
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 cameraPosition;
+		float pad;
+	};
+
+	// std140 layout of "uniform LightData"
+	struct LightData
+	{
+		Light lights[MAX_LIGHT_COUNT];
+		int lightCount;
+		int pad[3];
+	};
+
+	// std430 layout of one element of "buffer InstanceData": everything that differs between instances of an instanced draw
+	struct InstanceData
+	{
+		glm::mat4 world;
+		glm::vec3 albedo;
+		float metallic;
+		glm::vec3 emissive;
+		float roughness;
+		// the mesh's PositionDecode; its offset's w is always 0, so the LOD fade takes its place
+		glm::vec3 positionOffset;
+		float lodFade;
+		glm::vec4 positionScale;
+	};
+
+	// std430 layout of one element of "buffer InstanceBounds": what the occlusion culling pass knows about an instance
+	struct InstanceBounds
+	{
+		glm::vec3 min;
+		unsigned int command;   // index of the draw command the instance belongs to; ~0u skips the instance
+		glm::vec3 max;
+		unsigned int drawId;    // stable across frames, indexes DrawVisibility; ~0u means always drawn
+	};
+
+	// std430 layout of one element of "buffer ClusterItems": one meshlet of one instance for the cluster culling pass
+	struct ClusterItem
+	{
+		unsigned int instance;  // into InstanceData
+		unsigned int meshlet;   // into the MeshletArena
+		unsigned int clusterId; // like InstanceBounds::drawId, for the cluster's own visibility
+		unsigned int batch;     // into ClusterBatches
+	};
+
+	// std430 layout of one element of "buffer ClusterBatches": where the cluster culling pass appends the draw commands
+	// of a batch's visible clusters. commandCount comes first so it can be the draw count of glMultiDrawElementsIndirectCount.
+	struct ClusterBatch
+	{
+		unsigned int commandCount;
+		unsigned int firstCommand;  // into DrawCommands
+	};
+
+	// A uniform buffer object bound to a fixed binding point, so every program sees the same data
+	class UniformBuffer
+	{
+	public:
+		UniformBuffer() = default;
+		UniformBuffer(unsigned int size, unsigned int binding);
+
+		~UniformBuffer() = default;
+
+		// writes size bytes of data to the buffer at offset with one glBufferSubData
+		void Upload(const void* data, unsigned int size, unsigned int offset = 0);
+
+		template <typename T>
+		void Upload(const T& data)
+		{
+			Upload(&data, sizeof(T));
+		}
+
+		// (re)binds the buffer to its binding point
+		void Bind();
+
+		unsigned int ID = 0;
+		unsigned int size = 0;
+		unsigned int binding = 0;
+	};
+
+	// A shader storage buffer bound to a fixed binding point. Unlike a UniformBuffer it grows to fit whatever is uploaded.
+	class StorageBuffer
+	{
+	public:
+		StorageBuffer() = default;
+		StorageBuffer(unsigned int size, unsigned int binding);
+
+		~StorageBuffer() = default;
+
+		// replaces the buffer's contents, reallocating if they don't fit
+		void Upload(const void* data, unsigned int size);
+		// makes room for size bytes for the GPU to write; the contents are undefined if it had to reallocate
+		void Reserve(unsigned int size);
+
+		// (re)binds the buffer to its binding point
+		void Bind();
+
+		unsigned int ID = 0;
+		unsigned int size = 0;
+		unsigned int binding = 0;
+	};
+}
\ No newline at end of file
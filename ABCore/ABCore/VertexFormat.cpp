@@ -0,0 +1,71 @@
+#include "VertexFormat.h"
+#include "Mesh.h"
+
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+
+using namespace std;
+using namespace AB;
+
+// octahedral encoding: the unit sphere folded onto the square -1..1, which spreads precision evenly over all directions
+static glm::vec2 EncodeOctahedral(glm::vec3 n)
+{
+	n /= fabs(n.x) + fabs(n.y) + fabs(n.z);
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0.f)
+	{
+		// fold the lower half over the diagonals
+		p.x = (1.f - fabs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+		p.y = (1.f - fabs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+	}
+	return p;
+}
+
+VertexFormat AB::ResolveVertexFormat(VertexFormat format, unsigned int vertexCount)
+{
+	if (format == VERTEX_FORMAT_PACKED && vertexCount > MAX_PACKED_VERTEX_COUNT)
+		return VERTEX_FORMAT_FLOAT;
+	return format;
+}
+
+PositionDecode AB::GetPositionDecode(VertexFormat format, const AABB& bounds)
+{
+	PositionDecode decode;
+	if (format == VERTEX_FORMAT_PACKED && !bounds.IsEmpty())
+	{
+		decode.offset = glm::vec4(bounds.min, 0.f);
+		decode.scale = glm::vec4(bounds.max - bounds.min, 1.f);
+	}
+	return decode;
+}
+
+void AB::PackVertices(const Vertex* vertices, unsigned int vertexCount, const AABB& bounds, vector<PackedVertex>& packed)
+{
+	glm::vec3 size = bounds.max - bounds.min;
+	packed.resize(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		PackedVertex& out = packed[i];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t = size[axis] > 0.f ? (vertex.Position[axis] - bounds.min[axis]) / size[axis] : 0.f;
+			out.Position[axis] = glm::packUnorm1x16(t);
+		}
+		out.Position[3] = 0;
+
+		float length = glm::length(vertex.Normal);
+		glm::vec2 normal = length > 0.f ? EncodeOctahedral(vertex.Normal / length) : glm::vec2(0.f);
+		out.Normal[0] = (short)glm::packSnorm1x16(normal.x);
+		out.Normal[1] = (short)glm::packSnorm1x16(normal.y);
+
+		out.TexCoord[0] = glm::packHalf1x16(vertex.TexCoord.x);
+		out.TexCoord[1] = glm::packHalf1x16(vertex.TexCoord.y);
+	}
+}
+
+void AB::PackIndices(const unsigned int* indices, unsigned int indexCount, vector<unsigned short>& packed)
+{
+	packed.assign(indices, indices + indexCount);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace AB
+{
+	struct Vertex;
+	struct AABB;
+
+	// The layouts mesh geometry can be uploaded in. Each has its own GeometryArena.
+	enum VertexFormat
+	{
+		// Vertex as it is: 32 bytes, with 32-bit indices
+		VERTEX_FORMAT_FLOAT,
+		// PackedVertex: 16 bytes, with 16-bit indices, so only for meshes of up to 65536 vertices
+		VERTEX_FORMAT_PACKED,
+
+		VERTEX_FORMAT_COUNT
+	};
+
+	// Vertex at half the size.
+	// Shaders get the position in 0..1 of the mesh's bounds and the normal still octahedral encoded;
+	// include/vertex_format.glsl turns them back into a Vertex's with the mesh's PositionDecode.
+	struct PackedVertex
+	{
+		unsigned short Position[4];     // unorm16 across the mesh's bounds; w is padding
+		short Normal[2];                // snorm16 octahedral encoding
+		unsigned short TexCoord[2];     // half floats
+	};
+
+	// Maps a format's positions back to the mesh's own space in the shaders: position * scale.xyz + offset.xyz.
+	// scale.w is 1 for formats whose normals are octahedral encoded.
+	struct PositionDecode
+	{
+		glm::vec4 offset = glm::vec4(0.f);
+		glm::vec4 scale = glm::vec4(1.f, 1.f, 1.f, 0.f);
+	};
+
+	const unsigned int MAX_PACKED_VERTEX_COUNT = 65536;
+
+	// the format geometry asked to be in actually goes in; packed meshes with too many vertices for 16-bit indices stay floats
+	VertexFormat ResolveVertexFormat(VertexFormat format, unsigned int vertexCount);
+
+	// decode for geometry in format with the given bounds
+	PositionDecode GetPositionDecode(VertexFormat format, const AABB& bounds);
+
+	// converts to VERTEX_FORMAT_PACKED, quantizing the positions against bounds
+	void PackVertices(const Vertex* vertices, unsigned int vertexCount, const AABB& bounds, std::vector<PackedVertex>& packed);
+	void PackIndices(const unsigned int* indices, unsigned int indexCount, std::vector<unsigned short>& packed);
+}
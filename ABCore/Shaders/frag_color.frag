@@ -0,0 +1,10 @@
+#version 450 core
+
+in vec3 color;
+
+layout (location = 0) out vec3 fragColor;
+
+void main()
+{
+    fragColor = color;
+}
@@ -1,23 +1,8 @@
 #version 450 core
 
-// constants
-const uint LIGHT_TYPE_DIRECTIONAL = 0u;
-const uint LIGHT_TYPE_POINT = 1u;
-const uint LIGHT_TYPE_SPOT = 2u;
-const float MAX_SPECULAR_EXPONENT = 256.f;
-const uint MAX_LIGHT_COUNT = 10u;
-const float EPSILON = 0.0001f;
-
-struct Light
-{
-    uint Type;         // Which kind of light? 0, 1 or 2 (see above)
-    vec3 Direction;    // Directional and Spot lights need a direction
-    float Range;       // Point and Spot lights have a max range for attenuation
-    vec3 Position;     // Point and Spot lights have a position in space
-    float Intensity;   // All lights need an intensity
-    vec3 Color;        // All lights need a color
-    float SpotFalloff; // Spot lights need a value to define their cone size
-};
+#include "include/lights.glsl"
+#include "include/brdf.glsl"
+#include "include/raytracing.glsl"
 
 struct RaycastHit
 {
@@ -44,7 +29,6 @@ layout (binding = 2) uniform samplerBuffer worldData;
 uniform int indexCount;
 
 // lighting params
-uniform Light[MAX_LIGHT_COUNT] lights;
 uniform vec3 ambient;
 uniform vec3 screenColor;
 uniform int recursionDepth;
@@ -57,70 +41,6 @@ uniform vec3 cameraPos;
 in vec2 screenPos;
 out vec4 fragColor;
 
-// Basic lighting functions
-float DiffuseBRDF(vec3 normal, vec3 dirToLight)
-{
-    return clamp(dot(normal, dirToLight), 0.f, 1.f);
-}
-
-float SpecularBRDF(vec3 normal, vec3 lightDir, vec3 viewVector)
-{
-	// Get reflection of light bouncing off the surface 
-    return pow(clamp(dot(reflect(lightDir, normal), viewVector), 0.f, 1.f), 20.f);
-}
-
-vec3 Phong(vec3 normal, vec3 lightDir, vec3 lightColor, vec3 colorTint, vec3 viewVec, float specScale, float diffuseScale)
-{
-    // Calculate diffuse and specular values
-    float diffuse = DiffuseBRDF(normal, -lightDir) * diffuseScale;
-    float spec = SpecularBRDF(normal, lightDir, viewVec) * specScale;
-
-    // Cut the specular if the diffuse contribution is zero
-    spec *= diffuse < EPSILON ? 0.f : 1.f;
-
-    return lightColor * colorTint * (diffuse + spec);
-}
-
-float Attenuate(Light light, vec3 worldPos)
-{
-    float dist = distance(light.Position, worldPos);
-    return pow(clamp(1.0f - (dist * dist / (light.Range * light.Range)), 0.f, 1.f), 2);
-}
-
-vec3 GetBaryCoords(vec3 origin, vec3 dir, vec3 p0, vec3 p1, vec3 p2, out bool front)
-{
-    vec3 uvw = vec3(-1, -1, -1);
-
-    // get tri edges sharing p0
-    vec3 e1 = p1 - p0;
-    vec3 e2 = p2 - p0;
-
-    vec3 p = cross(dir, e2);
-    float det = dot(e1, p);
-
-    // if determinant is near 0, ray lies in tri plane.
-    front = det > 0;
-    if (abs(det) < EPSILON)
-        return uvw;
-
-    float f = (1.f / det);
-    vec3 toOrigin = origin - p0;
-    // calculate U and test if it's within tri bounds
-    uvw.x = f * dot(toOrigin, p);
-    if (uvw.x < 0.f || uvw.x > 1.f) 
-        return uvw;
-
-    // calculate V and test if coord is within tri bounds
-    vec3 q = cross(toOrigin, e1);
-    uvw.y = f * dot(dir, q);
-    if (uvw.y < 0.f || uvw.x + uvw.y > 1.f) 
-        return uvw;
-
-    // calculate distance
-    uvw.z = f * dot(e2, q);
-    return uvw;
-}
-
 // Casts a ray and returns the barycentric coords of the hit on the tri being tested against.
 // Returns false if no hit
 bool Raycast(vec3 origin, vec3 dir, out RaycastHit hit)
@@ -240,7 +160,7 @@ vec3 LocalIlluminate(vec3 origin, RaycastHit hit)
     vec3 hitColor = ambient * baseColor;
                 
     // Loop through the lights
-    for (uint i = 0u; i < MAX_LIGHT_COUNT; i++)
+    for (int i = 0; i < lightCount; i++)
     {
         vec3 lightDir = lights[i].Type == LIGHT_TYPE_DIRECTIONAL ? lights[i].Direction * 500.f : hit.position - lights[i].Position;
         bool attenuate = lights[i].Type != LIGHT_TYPE_DIRECTIONAL;
@@ -249,7 +169,7 @@ vec3 LocalIlluminate(vec3 origin, RaycastHit hit)
         if (!Raycast(hit.position, -lightDir, length(lightDir)))
         {
             lightDir = normalize(lightDir);
-            vec3 lightCol = Phong(hit.normal, lightDir, lights[i].Color, baseColor, viewVector, spec, hit.diffuse) * lights[i].Intensity; 
+            vec3 lightCol = Phong(hit.normal, lightDir, lights[i].Color, baseColor, viewVector, 20.f, spec, hit.diffuse) * lights[i].Intensity;
             if (attenuate) lightCol *= Attenuate(lights[i], hit.position);
             hitColor += lightCol;
         }
@@ -1,153 +1,8 @@
 #version 450 core
 
-// constants
-const uint LIGHT_TYPE_DIRECTIONAL = 0u;
-const uint LIGHT_TYPE_POINT = 1u;
-const uint LIGHT_TYPE_SPOT = 2u;
-const uint MAX_SPECULAR_EXPONENT = 256u;
-const uint MAX_LIGHT_COUNT = 10u;
-
-struct Light
-{
-    uint Type;         // Which kind of light? 0, 1 or 2 (see above)
-    vec3 Direction;    // Directional and Spot lights need a direction
-    float Range;       // Point and Spot lights have a max range for attenuation
-    vec3 Position;     // Point and Spot lights have a position in space
-    float Intensity;   // All lights need an intensity
-    vec3 Color;        // All lights need a color
-    float SpotFalloff; // Spot lights need a value to define their �cone� size
-};
-
-// Basic lighting functions
-float DiffuseBRDF(vec3 normal, vec3 dirToLight)
-{
-    return clamp(dot(normal, dirToLight), 0, 1);
-}
-
-float Attenuate(Light light, vec3 worldPos)
-{
-    float dist = distance(light.Position, worldPos);
-    float att = clamp(1.0f - (dist * dist / (light.Range * light.Range)), 0.f, 1.f);
-    return att * att;
-}
-
-// -------------------------------------------------------- \\
-// -- PHYSICALLY-BASED RENDERING FUNCTIONS AND CONSTANTS (Cook-Torrence) -- \\
-// -------------------------------------------------------- \\
-
-// The fresnel value for non-metals (dielectrics)
-const float NONMETAL_F0 = 0.04f;
-const float MIN_ROUGHNESS = 0.0000001f;
-const float PI = 3.14159265359f;
-
-// Calculates diffuse amount based on energy conservation
-vec3 DiffuseEnergyConserve(float diffuse, vec3 F, float metalness)
-{
-    return diffuse * (1 - F) * (1 - metalness);
-}
-
-// Normal Distribution Function: GGX (Trowbridge-Reitz)
-float D_GGX(vec3 n, vec3 h, float roughness)
-{
-    float NdotH = clamp(dot(n, h), 0.f, 1.f);
-    float NdotH2 = NdotH * NdotH;
-    float a = roughness * roughness;
-    float a2 = max(a * a, MIN_ROUGHNESS);
-
-	// ((n dot h)^2 * (a^2 - 1) + 1)
-    float denomToSquare = NdotH2 * (a2 - 1) + 1;
-
-	// Final value
-    return a2 / (PI * denomToSquare * denomToSquare);
-}
-
-// Fresnel term - Schlick approx.
-vec3 F_Schlick(vec3 v, vec3 h, vec3 f0)
-{
-    float VdotH = clamp(dot(v, h), 0.f, 1.f);
-    return f0 + (1 - f0) * pow(1 - VdotH, 5);
-}
-
-// Geometric Shadowing - Schlick-GGX
-float G_SchlickGGX(vec3 n, vec3 v, float roughness)
-{
-	// remapping
-    float k = pow(roughness + 1, 2) / 8.0f;
-    float NdotV = clamp(dot(n, v), 0.f, 1.f);
-
-	// Final value
-    return 1 / (NdotV * (1 - k) + k);
-}
-
-// Cook-Torrance Microfacet BRDF (Specular)
-vec3 MicrofacetBRDF(vec3 n, vec3 l, vec3 v, float roughness, vec3 f0, out vec3 F_out)
-{
-    vec3 h = normalize(v + l);
-
-	// Run numerator functions
-    float D = D_GGX(n, h, roughness);
-    vec3 F = F_Schlick(v, h, f0);
-    float G = G_SchlickGGX(n, v, roughness) * G_SchlickGGX(n, l, roughness);
-	
-    F_out = F;
-
-	// Final specular formula
-    vec3 specularResult = (D * F * G) / 4;
-
-	// According to the rendering equation,
-	// specular must have the same NdotL applied as diffuse
-    return specularResult * max(dot(n, l), 0);
-}
-
-vec3 ColorFromLightPBR(vec3 normal, vec3 lightDir, vec3 lightColor, vec3 surfaceColor,
-    vec3 viewVec, float roughness, float metalness, vec3 specColor)
-{
-    float diffuse = DiffuseBRDF(normal, -lightDir);
-    
-    vec3 fresnel;
-    // Get specular color and fresnel result
-    vec3 spec = MicrofacetBRDF(normal, -lightDir, viewVec, roughness, specColor, fresnel);
-    
-    // Calculate diffuse with energy conservation, including cutting diffuse for metals
-    vec3 balancedDiff = DiffuseEnergyConserve(diffuse, fresnel, metalness);
-    
-    // Combine the final diffuse and specular values for this light
-    return (balancedDiff * surfaceColor + spec) * lightColor;
-}
-
-#define EPSILON 0.0001f
-
-// Casts a ray and returns the barycentric coords of the hit on the tri being tested against.
-// Returns false if no hit
-bool RaycastTri(vec3 origin, vec3 dir, vec3 p0, vec3 p1, vec3 p2, out vec3 result)
-{
-    // get tri edges sharing p0
-    vec3 e1 = p1 - p0;
-    vec3 e2 = p2 - p0;
-
-    vec3 p = cross(dir, e2);
-    float det = dot(e1, p);
-
-    // if determinant is near 0, ray lies in tri plane.
-    if (det < EPSILON)
-        return false;
-
-    float f = (1.f / det);
-    vec3 toOrigin = origin - p0;
-    // calculate U and test if it's within tri bounds
-    result.x = f * dot(toOrigin, p);
-    if (result.x < 0.f || result.x > 1.f) 
-        return false;
-
-    // calculate V and test if coord is within tri bounds
-    vec3 q = cross(toOrigin, e1);
-    result.y = f * dot(dir, q);
-    if (result.y < 0.f || result.x + result.y > 1.f) 
-        return false;
-
-    result.z = f * dot(e2, q);
-    return true;
-}
+#include "include/lights.glsl"
+#include "include/brdf.glsl"
+#include "include/raytracing.glsl"
 
 // Each vertex takes up 3 texels in the buffer
 // i = vertex position, i + 1 = vertex normal, i + 2 = vertex texcoord
@@ -161,7 +16,6 @@ layout (binding = 2) uniform samplerBuffer worldData;
 uniform int indexCount;
 
 // lighting params
-uniform Light[MAX_LIGHT_COUNT] lights;
 uniform vec3 ambient;
 uniform vec3 screenColor;
 
@@ -199,8 +53,9 @@ void main()
         vec3 p2w = vec3(world * vec4(texelFetch(vertData, i2 * 3).xyz, 1));
 
         // Raycast from camera position through this pixel to see if it hits this tri
-        vec3 hit;
-        if (RaycastTri(cameraPos, rayDir.xyz - cameraPos, p0w, p1w, p2w, hit))
+        bool front;
+        vec3 hit = GetBaryCoords(cameraPos, rayDir.xyz - cameraPos, p0w, p1w, p2w, front);
+        if (front)
         {
             if (hit.z > EPSILON && hit.z < nearest)
             {
@@ -230,7 +85,7 @@ void main()
                 vec3 totalLightColor = ambient * baseColor * (1 - placeholderMetal);
                 
                 // Loop through the lights
-                for (uint i = 0u; i < MAX_LIGHT_COUNT; i++)
+                for (int i = 0; i < lightCount; i++)
                 {
                     vec3 lightDir;
                     bool attenuate = false;
@@ -264,8 +119,9 @@ void main()
                         vec3 p2w = vec3(world * vec4(texelFetch(vertData, texelFetch(indexData, i + 2).x * 3).xyz, 1));
 
                         // Raycast from camera position through this pixel to see if it hits this tri
-                        vec3 shadowHit;
-                        if (RaycastTri(worldPos, -lightDir, p0w, p1w, p2w, shadowHit))
+                        bool shadowFront;
+                        vec3 shadowHit = GetBaryCoords(worldPos, -lightDir, p0w, p1w, p2w, shadowFront);
+                        if (shadowFront)
                         {
                             if (shadowHit.z > EPSILON && shadowHit.z < lightDist)
                             {
@@ -276,15 +132,16 @@ void main()
                     }
                     if (!hit) // no hits detected, do the lighting thing
                     {
-                        vec3 lightCol = ColorFromLightPBR( // Cook-Torrence
+                        vec3 lightCol = CookTorrence(
                             normal, 
                             lightDir, 
                             lights[i].Color, 
                             baseColor, 
                             viewVector,
+                            lights[i].Intensity,
                             placeholderRough, 
                             placeholderMetal, 
-                            specularColor) * lights[i].Intensity;
+                            specularColor);
                     
                         // If this is a point or spot light, attenuate the color
                         if (attenuate)
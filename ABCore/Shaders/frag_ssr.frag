@@ -9,8 +9,8 @@ layout (binding = 1) uniform sampler2D normalTexture;
 layout (binding = 2) uniform sampler2D depthTexture;
 
 // INPUTS, UNIFORM, OUTPUTS
-uniform mat4 projection;
-uniform mat4 view;
+#include "include/frame_data.glsl"
+
 uniform vec4 ambient;
 
 out vec4 fragColor;
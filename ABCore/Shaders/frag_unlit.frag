@@ -1,12 +1,13 @@
 #version 450 core
 
-uniform vec3 albedoColor;
+uniform uint patchId;
 uniform bool topHalf;
 uniform int size;
 
-layout (location = 0) out vec3 fragColor;
+layout (location = 0) out uint fragId;
 
 void main()
 {
-    fragColor = topHalf && gl_FragCoord.y < size / 2.f ? vec3(0) : albedoColor;
+    // id of 0 is reserved for nothing being rendered
+    fragId = topHalf && gl_FragCoord.y < size / 2.f ? 0u : patchId;
 }
@@ -0,0 +1,113 @@
+// Lighting models: Phong, and Cook-Torrance for PBR.
+
+const float MAX_SPECULAR_EXPONENT = 256.f;
+
+// Lambertian Diffuse
+float DiffuseBRDF(vec3 normal, vec3 dirToLight)
+{
+    return clamp(dot(normal, dirToLight), 0.f, 1.f);
+}
+
+// Specular from Phong
+float SpecularBRDF(vec3 normal, vec3 lightDir, vec3 viewVector, float specExponent)
+{
+    // Get reflection of light bouncing off the surface
+    return pow(clamp(dot(reflect(lightDir, normal), viewVector), 0.f, 1.f), specExponent);
+}
+
+vec3 Phong(vec3 normal, vec3 lightDir, vec3 lightColor, vec3 colorTint, vec3 viewVec, float specExponent, float specScale, float diffuseScale)
+{
+    // Calculate diffuse and specular values
+    float diffuse = DiffuseBRDF(normal, -lightDir) * diffuseScale;
+    float spec = SpecularBRDF(normal, lightDir, viewVec, specExponent) * specScale;
+
+    // Cut the specular if the diffuse contribution is zero
+    spec *= diffuse < 0.0001f ? 0.f : 1.f;
+
+    return lightColor * colorTint * (diffuse + spec);
+}
+
+// -------------------------------------------------------- \\
+// --     PHYSICALLY-BASED RENDERING (Cook-Torrence)     -- \\
+// -------------------------------------------------------- \\
+
+// The fresnel value for non-metals
+const float NONMETAL_F0 = 0.04f;
+const float MIN_ROUGHNESS = 0.0000001f;
+const float PI = 3.14159265359f;
+
+// Diffuse from energy conservation
+vec3 DiffuseEnergyConserve(float diffuse, vec3 F, float metalness)
+{
+    return diffuse * (1 - F) * (1 - metalness);
+}
+
+// Normal Distribution Trowbridge-Reitz
+// D(h, n, a) = a^2 / pi * ((n dot h)^2 * (a^2 - 1) + 1)^2
+float D_GGX(vec3 n, vec3 h, float roughness)
+{
+	// Pre-calculations
+    float NdotH = clamp(dot(n, h), 0.f, 1.f);
+    float NdotH2 = NdotH * NdotH;
+    float a = roughness * roughness;
+    float a2 = max(a * a, MIN_ROUGHNESS);
+
+	// ((n dot h)^2 * (a^2 - 1) + 1)
+    float denomToSquare = NdotH2 * (a2 - 1) + 1;
+
+    return a2 / (PI * denomToSquare * denomToSquare);
+}
+
+// Fresnel term - Schlick
+// F(v,h,f0) = f0 + (1-f0)(1 - (v dot h))^5
+vec3 F_Schlick(vec3 v, vec3 h, vec3 f0)
+{
+    float VdotH = clamp(dot(v, h), 0.f, 1.f);
+    return f0 + (1 - f0) * pow(1 - VdotH, 5);
+}
+
+// Geometric Shadowing - Schlick-GGX
+// - k is remapped to a / 2, roughness remapped to (r+1)/2 before squaring
+float G_SchlickGGX(vec3 n, vec3 v, float roughness)
+{
+	// remapping
+    float k = pow(roughness + 1, 2) / 8.0f;
+    float NdotV = clamp(dot(n, v), 0.f, 1.f);
+
+    return 1 / (NdotV * (1 - k) + k);
+}
+
+// Cook-Torrance Microfacet BRDF (Specular)
+// f(l,v) = D(h)F(v,h)G(l,v,h) / 4(n dot l)(n dot v)
+vec3 MicrofacetBRDF(vec3 n, vec3 l, vec3 v, float roughness, vec3 f0, out vec3 F_out)
+{
+    vec3 h = normalize(v + l);
+
+	// Run numerator functions
+    float D = D_GGX(n, h, roughness);
+    vec3 F = F_Schlick(v, h, f0);
+    float G = G_SchlickGGX(n, v, roughness) * G_SchlickGGX(n, l, roughness);
+	
+    F_out = F;
+
+	// Final specular formula
+    vec3 specularResult = (D * F * G) / 4.f;
+    return specularResult * max(dot(n, l), 0);
+}
+
+vec3 CookTorrence(vec3 normal, vec3 lightDir, vec3 lightColor, vec3 surfaceColor,
+    vec3 viewVec, float lightIntensity, float roughness, float metalness, vec3 specColor)
+{
+    // Diffuse uses same formula as Phong
+    float diffuse = DiffuseBRDF(normal, -lightDir);
+    
+    // Get specular color and fresnel result
+    vec3 fresnel;
+    vec3 spec = MicrofacetBRDF(normal, -lightDir, viewVec, roughness, specColor, fresnel);
+    
+    // Calculate diffuse with energy conservation
+    vec3 balancedDiff = DiffuseEnergyConserve(diffuse, fresnel, metalness);
+    
+    // Final diffuse & specular combination
+    return (balancedDiff * surfaceColor + spec) * lightIntensity * lightColor;
+}
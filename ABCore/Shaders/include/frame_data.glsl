@@ -0,0 +1,7 @@
+// Per-frame camera data shared by all programs (AB::FrameData, bound by AB::Shader)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPosition;
+};
@@ -0,0 +1,44 @@
+// Occlusion test of world space boxes against the Hi-Z pyramid built by hiz_downsample.comp (see AB::OcclusionCuller)
+
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform vec2 depthSize;         // size of the depth buffer the pyramid was built from
+
+// true if the box is entirely behind the depth in the pyramid
+bool IsOccluded(vec3 boxMin, vec3 boxMax)
+{
+    // screen rectangle (in depth buffer pixels) and nearest depth of the box's corners
+    vec2 rectMin = vec2(1.0), rectMax = vec2(0.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x, (i & 2) != 0 ? boxMax.y : boxMin.y, (i & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+
+        // a box crossing the near plane can't be projected; treat it as visible
+        if (clip.w <= 0.0)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        rectMin = min(rectMin, ndc.xy * 0.5 + 0.5);
+        rectMax = max(rectMax, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    vec2 pixelMin = clamp(rectMin, 0.0, 1.0) * depthSize;
+    vec2 pixelMax = clamp(rectMax, 0.0, 1.0) * depthSize;
+
+    // level 0 texels cover 2x2 pixels; pick the level where the rectangle spans at most 2x2 texels
+    vec2 extent = (pixelMax - pixelMin) * 0.5;
+    int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    level = clamp(level, 0, textureQueryLevels(hiZ) - 1);
+
+    ivec2 size = textureSize(hiZ, level);
+    ivec2 texelMin = min(ivec2(pixelMin) >> (level + 1), size - 1);
+    ivec2 texelMax = min(ivec2(pixelMax) >> (level + 1), size - 1);
+
+    float farthest = max(
+        max(texelFetch(hiZ, texelMin, level).r, texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).r),
+        max(texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(hiZ, texelMax, level).r));
+
+    return nearest > farthest;
+}
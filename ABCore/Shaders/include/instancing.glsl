@@ -0,0 +1,25 @@
+// Per-instance data of instanced draws (AB::InstanceData, filled by AB::RenderQueue).
+// vInstance is the draw's base instance + gl_InstanceID, read from the GeometryArena's identity buffer
+// (a divisor-1 attribute honors base instance, unlike gl_InstanceID), so this also works for multi-draw-indirect.
+
+struct Instance
+{
+    mat4 world;
+    vec3 albedo;
+    float metallic;
+    vec3 emissive;
+    float roughness;
+    vec3 positionOffset;
+    float lodFade;
+    vec4 positionScale;
+};
+
+layout (std430) readonly buffer InstanceData
+{
+    Instance instances[];
+};
+
+// compute shaders that only read the buffer define INSTANCE_DATA_ONLY
+#ifndef INSTANCE_DATA_ONLY
+layout (location = 3) in uint vInstance;
+#endif
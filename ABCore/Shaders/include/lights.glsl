@@ -0,0 +1,35 @@
+// Light types, the Light struct and the light block shared by all programs (AB::Light / AB::LightData).
+// MAX_LIGHT_COUNT is defined by AB::Shader from AB::MAX_LIGHT_COUNT so the block layout always matches.
+
+#ifndef MAX_LIGHT_COUNT
+#define MAX_LIGHT_COUNT 10
+#endif
+
+const uint LIGHT_TYPE_DIRECTIONAL = 0u;
+const uint LIGHT_TYPE_POINT = 1u;
+const uint LIGHT_TYPE_SPOT = 2u;
+
+struct Light
+{
+    uint Type;         // Light Type = 0, 1 or 2 (see above)
+    vec3 Direction;    // Direction for Directional and Spot lights
+    float Range;       // Attenuation for Point and Spot lights
+    vec3 Position;     // Position for Point and Spot lights
+    float Intensity;   // Light intensity
+    vec3 Color;        // Light color
+    float SpotFalloff; // Cone size for Spot Lights (unused)
+};
+
+layout (std140) uniform LightData
+{
+    Light lights[MAX_LIGHT_COUNT];
+    int lightCount;
+};
+
+// Range falloff for Point and Spot lights
+float Attenuate(Light light, vec3 worldPos)
+{
+    float dist = distance(light.Position, worldPos);
+    float att = clamp(1.0f - (dist * dist / (light.Range * light.Range)), 0.f, 1.f);
+    return att * att;
+}
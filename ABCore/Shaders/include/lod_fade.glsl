@@ -0,0 +1,22 @@
+// Cross-fades between two LODs of a mesh (see AB::RenderQueue::lodFadeFrames) by drawing both, each discarding
+// the pixels of a 4x4 ordered dither the other one keeps. lodFade is the fade in 0..1 for the LOD being faded in,
+// minus it for the one being faded out, and 0 when not fading. Instanced shaders read it from their Instance.
+
+flat in float ditherFade;
+
+const float bayer4x4[16] = float[16](
+     0.0,  8.0,  2.0, 10.0,
+    12.0,  4.0, 14.0,  6.0,
+     3.0, 11.0,  1.0,  9.0,
+    15.0,  7.0, 13.0,  5.0);
+
+void ApplyLODFade()
+{
+    if (ditherFade == 0.0)
+        return;
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (bayer4x4[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+    if (ditherFade > 0.0 ? threshold >= ditherFade : threshold < -ditherFade)
+        discard;
+}
@@ -0,0 +1,39 @@
+// Ray/triangle intersection shared by the raytracing shaders
+
+const float EPSILON = 0.0001f;
+
+// Moller-Trumbore. Returns (u, v, distance) of the ray's hit on the tri; distance is -1 if it misses.
+// front is whether the ray hit the tri's front face.
+vec3 GetBaryCoords(vec3 origin, vec3 dir, vec3 p0, vec3 p1, vec3 p2, out bool front)
+{
+    vec3 uvw = vec3(-1, -1, -1);
+
+    // get tri edges sharing p0
+    vec3 e1 = p1 - p0;
+    vec3 e2 = p2 - p0;
+
+    vec3 p = cross(dir, e2);
+    float det = dot(e1, p);
+
+    // if determinant is near 0, ray lies in tri plane.
+    front = det > 0;
+    if (abs(det) < EPSILON)
+        return uvw;
+
+    float f = (1.f / det);
+    vec3 toOrigin = origin - p0;
+    // calculate U and test if it's within tri bounds
+    uvw.x = f * dot(toOrigin, p);
+    if (uvw.x < 0.f || uvw.x > 1.f) 
+        return uvw;
+
+    // calculate V and test if coord is within tri bounds
+    vec3 q = cross(toOrigin, e1);
+    uvw.y = f * dot(dir, q);
+    if (uvw.y < 0.f || uvw.x + uvw.y > 1.f) 
+        return uvw;
+
+    // calculate distance
+    uvw.z = f * dot(e2, q);
+    return uvw;
+}
@@ -0,0 +1,28 @@
+// Decodes the vertex attributes of either AB::VertexFormat, so a shader that includes this can draw meshes in both.
+// Packed meshes give vPos in 0..1 of their bounds and vNormal.xy octahedral encoded; positionOffset and positionScale
+// (AB::PositionDecode) map them back, and are the identity for float meshes.
+// Instanced shaders read them from their Instance instead of these uniforms.
+
+#ifndef USE_INSTANCING
+uniform vec4 positionOffset = vec4(0.0);
+uniform vec4 positionScale = vec4(1.0, 1.0, 1.0, 0.0);
+#endif
+
+vec3 DecodePosition(vec3 position, vec4 offset, vec4 scale)
+{
+    return position * scale.xyz + offset.xyz;
+}
+
+// scale.w is 1 when the normal is octahedral encoded
+vec3 DecodeNormal(vec3 normal, vec4 scale)
+{
+    if (scale.w == 0.0)
+        return normal;
+
+    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+    // unfold the lower half
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
@@ -8,7 +8,9 @@ uniform mat4 world;
 uniform mat4 view;
 uniform mat4 projection;
 
+#include "include/vertex_format.glsl"
+
 void main()
 {
-    gl_Position = projection * view * world * vec4(vPos, 1.0);
+    gl_Position = projection * view * world * vec4(DecodePosition(vPos, positionOffset, positionScale), 1.0);
 }
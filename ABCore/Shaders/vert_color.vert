@@ -0,0 +1,17 @@
+#version 450 core
+
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in vec3 vColor;
+
+uniform mat4 world;
+
+#include "include/frame_data.glsl"
+
+out vec3 color;
+
+// Passes a per-vertex color through to be interpolated across the triangle
+void main()
+{
+    gl_Position = projection * view * world * vec4(vPos, 1.0);
+    color = vColor;
+}
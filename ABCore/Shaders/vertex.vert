@@ -1,12 +1,30 @@
-#version 330 core
+#version 450 core
+
+// Define USE_INSTANCING to read world matrices and material params per instance from the InstanceData buffer.
+// Define USE_LOD_FADE to pass the LOD fade on to include/lod_fade.glsl.
 
 layout (location = 0) in vec3 vPos;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec2 vTexCoord;
 
+#include "include/frame_data.glsl"
+#include "include/vertex_format.glsl"
+
+#ifdef USE_INSTANCING
+#include "include/instancing.glsl"
+
+flat out vec4 instanceAlbedoMetallic;
+flat out vec4 instanceEmissiveRoughness;
+#else
 uniform mat4 world;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef USE_LOD_FADE
+uniform float lodFade = 0.0;
+#endif
+#endif
+
+#ifdef USE_LOD_FADE
+flat out float ditherFade;
+#endif
 
 out vec3 worldPos;
 out vec3 normal;
@@ -14,9 +32,23 @@ out vec2 texCoord;
 
 void main()
 {
-    gl_Position = projection * view * world * vec4(vPos, 1.0);
+#ifdef USE_INSTANCING
+    Instance instance = instances[vInstance];
+    mat4 world = instance.world;
+    vec4 positionOffset = vec4(instance.positionOffset, 0.0);
+    vec4 positionScale = instance.positionScale;
+    float lodFade = instance.lodFade;
+    instanceAlbedoMetallic = vec4(instance.albedo, instance.metallic);
+    instanceEmissiveRoughness = vec4(instance.emissive, instance.roughness);
+#endif
+
+    vec3 position = DecodePosition(vPos, positionOffset, positionScale);
+    gl_Position = projection * view * world * vec4(position, 1.0);
 
-    worldPos = (world * vec4(vPos, 1.f)).xyz;
-    normal = inverse(transpose(mat3(world))) * vNormal;
+    worldPos = (world * vec4(position, 1.f)).xyz;
+    normal = inverse(transpose(mat3(world))) * DecodeNormal(vNormal, positionScale);
     texCoord = vTexCoord;
+#ifdef USE_LOD_FADE
+    ditherFade = lodFade;
+#endif
 }
@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <ABCore/Scene.h>
+#include <ABCore/RenderState.h>
 
 #include <thread>
 
@@ -26,24 +27,6 @@ using namespace AB;
 GLFWwindow* window;
 int width = 1000, height = 1000;
 
-struct Light
-{
-    unsigned int Type;         
-    glm::vec3 Direction;    
-    float Range;
-    glm::vec3 Position;
-    float Intensity;   
-    glm::vec3 Color;
-    float SpotFalloff; 
-};
-
-enum LightType : int
-{
-    LIGHT_TYPE_DIRECTIONAL,
-    LIGHT_TYPE_POINT,
-    LIGHT_TYPE_SPOT
-};
-
 vector<Light> lights;
 Shader trShader;
 Mesh tri;
@@ -63,8 +46,8 @@ GameObject* mFloor;
 
 void init()
 {
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    RenderState::Get().SetCullFace(true);
+    RenderState::Get().SetDepthTest(true);
 
     trShader = Shader("../ABCore/Shaders/vert_screen.vert", "../ABCore/Shaders/frag_TR.frag");
     tri = Mesh(
@@ -135,7 +118,7 @@ void init()
         glm::mat4 world = obj.GetWorldTM().GetMatrix();
         for (auto& mesh : obj.GetMeshes())
         {
-            for (auto& vert : mesh.vertices)
+            for (auto& vert : mesh->vertices)
             {
                 vert.Position = glm::vec3(world * glm::vec4(vert.Position, 1));
                 vert.Normal = glm::normalize(glm::inverse(glm::transpose(glm::mat3(world))) * vert.Normal);
@@ -380,7 +363,7 @@ void display(void)
     trShader.SetFloat("bias", 0.85f);
     trShader.SetUint("operator", 0);
 
-    glBindTexture(GL_TEXTURE_2D, viewportTex);
+    RenderState::Get().BindTexture(0, viewportTex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_FLOAT, colorData);
     glGenerateMipmap(GL_TEXTURE_2D);
     
@@ -15,8 +15,13 @@
 #include <GLFW/glfw3.h>
 
 #include <iostream>
+#include <sstream>
 #include <ABCore/Scene.h>
 #include <ABCore/Input.h>
+#include <ABCore/UniformBuffer.h>
+#include <ABCore/RenderState.h>
+#include <ABCore/OcclusionCuller.h>
+#include <ABCore/AssetLoader.h>
 
 using namespace std;
 using namespace AB;
@@ -24,76 +29,74 @@ using namespace AB;
 // the window's width and height
 int width = 1280, height = 720;
 
-struct Light
-{
-    unsigned int Type;
-    glm::vec3 Direction;
-    float Range;
-    glm::vec3 Position;
-    float Intensity;
-    glm::vec3 Color;
-    float SpotFalloff;
-};
-
-enum LightType : int
-{
-    LIGHT_TYPE_DIRECTIONAL,
-    LIGHT_TYPE_POINT,
-    LIGHT_TYPE_SPOT
-};
-
 vector<Light> lights;
 Shader shader, ssrShader;
+UniformBuffer frameUBO, lightUBO;
 Mesh ssrTri;
 unsigned int framebuffer;
 unsigned int colorTex, depthTex, normalTex;
 unsigned int depthStencil;
+OcclusionCuller occlusionCuller;
 
 Transform camTM;
 glm::vec2 camEulers;
 float dt, oldT;
 float camSpeed = 3.f;
 
+// number of extra fir trees to scatter around the scene (--forest <count>)
+int forestSize = 0;
+
 void init()
 {
     stbi_set_flip_vertically_on_load(true);
 
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    RenderState::Get().SetCullFace(true);
+    RenderState::Get().SetDepthTest(true);
 
     oldT = glfwGetTime();
 
     // set up shader
-    shader = Shader("./Shaders/vertex.vert", "./Shaders/frag_lit_pbr.frag");
+    shader = Shader("./Shaders/vertex.vert", "./Shaders/frag_lit_pbr.frag", { "USE_PBR" });
     ssrShader = Shader("./Shaders/vert_screen.vert", "./Shaders/frag_ssr.frag");
 
-    // set up scene models
+    // per-frame camera and light data, shared by both shaders
+    frameUBO = UniformBuffer(sizeof(FrameData), FRAME_DATA_BINDING);
+    lightUBO = UniformBuffer(sizeof(LightData), LIGHT_DATA_BINDING);
+
+    // set up scene models. They load in the background and show up as placeholder cubes until they're ready.
     Scene& scene = Scene::Get();
-    GameObject* firTree = scene.Add(GameObject("./Assets/Fir_Tree.fbx", "Fir Tree"));
+    AssetLoader& loader = AssetLoader::Get();
+    // vertex.vert decodes packed vertices, so the models can go up at half the size
+    loader.vertexFormat = VERTEX_FORMAT_PACKED;
+    // frag_lit_pbr.frag dithers between LODs, so the forest doesn't pop as the camera moves through it
+    scene.GetRenderQueue().lodFadeFrames = 30;
+    Texture bark = loader.LoadTexture("texture_diffuse", "tree_diffuse.png", "./Assets");
+    auto addBark = [bark](vector<shared_ptr<Mesh>>& meshes)
+    {
+        for (auto& m : meshes)
+            m->textures.push_back(bark);
+    };
+
+    GameObject* firTree = scene.Add(GameObject(loader.LoadModel("./Assets/Fir_Tree.fbx", addBark), "Fir Tree"));
     firTree->SetWorldTM({ 1, 0, -2.f }, glm::quat({ 0, 0.7, 0 }), { 0.01, 0.01, 0.01 });
-    for (Mesh& m : firTree->GetMeshes())
-        m.AddTexture("texture_diffuse", "tree_diffuse.png", "./Assets/");
+    GameObject forestTree = *firTree;
 
-    GameObject* poplarTree = scene.Add(GameObject("./Assets/Poplar_Tree.fbx", "Poplar Tree"));
+    GameObject* poplarTree = scene.Add(GameObject(loader.LoadModel("./Assets/Poplar_Tree.fbx", addBark), "Poplar Tree"));
     poplarTree->SetWorldTM({ 4, 0, -2 }, glm::quat({ 0, 0, 0 }), { 0.01, 0.01, 0.01 });
-    for (Mesh& m : poplarTree->GetMeshes())
-        m.AddTexture("texture_diffuse", "tree_diffuse.png", "./Assets");
 
-    GameObject* palmTree = scene.Add(GameObject("./Assets/Palm_Tree.fbx", "Palm Tree"));
+    GameObject* palmTree = scene.Add(GameObject(loader.LoadModel("./Assets/Palm_Tree.fbx", addBark), "Palm Tree"));
     palmTree->SetWorldTM({ 5, 0, -4.5 }, glm::quat({ 0, 0, 0 }), { 0.01, 0.01, 0.01 });
-    for (Mesh& m : palmTree->GetMeshes())
-        m.AddTexture("texture_diffuse", "tree_diffuse.png", "./Assets");
 
-    GameObject* oakTree = scene.Add(GameObject("./Assets/Oak_Tree.fbx", "Oak Tree"));
+    GameObject* oakTree = scene.Add(GameObject(loader.LoadModel("./Assets/Oak_Tree.fbx", addBark), "Oak Tree"));
     oakTree->SetWorldTM({ 2.5, 0, -6 }, glm::quat({ 0, 0, 0 }), { 0.01, 0.01, 0.01 });
-    for (Mesh& m : oakTree->GetMeshes())
-        m.AddTexture("texture_diffuse", "tree_diffuse.png", "./Assets");
 
-    vector<int> indices = { 0, 1, 2, 0, 2, 3 };
-    GameObject* ground = scene.Add(GameObject("./Assets/Terrain.fbx", "Ground"));
+    Texture groundTex = loader.LoadTexture("texture_diffuse", "forest_ground.png", "./Assets");
+    GameObject* ground = scene.Add(GameObject(loader.LoadModel("./Assets/Terrain.fbx", [groundTex](vector<shared_ptr<Mesh>>& meshes)
+    {
+        for (auto& m : meshes)
+            m->textures.push_back(groundTex);
+    }), "Ground"));
     ground->SetWorldTM(Transform({ 40, -3, -42.5 }, glm::quat(), { 0.01, 0.01, 0.01 }));
-    for (Mesh& m : ground->GetMeshes())
-        m.AddTexture("texture_diffuse", "forest_ground.png", "./Assets");
 
     GameObject* water = Scene::Get().Add(GameObject({ Mesh(
         {
@@ -108,6 +111,15 @@ void init()
     water->GetMaterial().albedo = { 0.0f, 0.0f, 0.5f };
     water->GetMaterial().roughness = 0.5f;
 
+    // copies share the fir tree's meshes, so the render queue draws the whole forest instanced
+    int forestSide = (int)glm::ceil(glm::sqrt((float)forestSize));
+    for (int i = 0; i < forestSize; i++)
+    {
+        glm::vec3 position = { (i % forestSide) * 1.5f - forestSide * 0.75f, 0, -8.f - (i / forestSide) * 1.5f };
+        forestTree.SetWorldTM(position, glm::quat({ 0, i * 2.39996f, 0 }), { 0.01, 0.01, 0.01 });
+        scene.Add(GameObject(forestTree));
+    }
+
     // set up lights
     Light point = {};
     point.Type = LIGHT_TYPE_POINT;
@@ -134,11 +146,11 @@ void init()
 
     // Create framebuffers and textures to render to
     glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    RenderState::Get().BindFramebuffer(framebuffer);
 
     // generate textures for rendering to
     glGenTextures(1, &colorTex);
-    glBindTexture(GL_TEXTURE_2D, colorTex);
+    RenderState::Get().BindTexture(0, colorTex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -146,14 +158,14 @@ void init()
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
 
     glGenTextures(1, &normalTex);
-    glBindTexture(GL_TEXTURE_2D, normalTex);
+    RenderState::Get().BindTexture(0, normalTex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTex, 0);
 
     glGenTextures(1, &depthTex);
-    glBindTexture(GL_TEXTURE_2D, depthTex);
+    RenderState::Get().BindTexture(0, depthTex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -168,7 +180,12 @@ void init()
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         cout << "ERROR: Framebuffer shat itself!" << endl;
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    RenderState::Get().BindFramebuffer(0);
+
+    // cull what's hidden behind closer objects, using the depth the scene pass leaves in depthTex
+    occlusionCuller = OcclusionCuller("./Shaders/");
+    occlusionCuller.SetDepthTexture(depthTex, width, height);
+    Scene::Get().SetOcclusionCuller(&occlusionCuller);
 }
 
 void Tick()
@@ -216,53 +233,55 @@ void display()
     glm::mat4 proj = glm::perspective(glm::radians(80.f), (float)width / (float)height, 0.1f, 1000.f);
     glm::vec4 ambient = glm::vec4(0.05f, 0.05f, 0.05f, 1.f);
 
+    RenderState& state = RenderState::Get();
+    state.BeginFrame();
+
     // set to render to the framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glEnable(GL_DEPTH_TEST);
+    state.BindFramebuffer(framebuffer);
+    state.SetDepthTest(true);
     glClearColor(0.1f, 0.1f, 0.1f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // upload the camera and lights once for every shader this frame
+    FrameData frame = {};
+    frame.view = view;
+    frame.projection = proj;
+    frame.cameraPosition = camTM.GetTranslation();
+    frameUBO.Upload(frame);
+
+    LightData lightData = {};
+    lightData.lightCount = (int)glm::min((unsigned int)lights.size(), MAX_LIGHT_COUNT);
+    for (int i = 0; i < lightData.lightCount; i++)
+        lightData.lights[i] = lights[i];
+    lightUBO.Upload(lightData);
+
     // use normal shader to render colors, normals and positions to textures
     shader.use();
-
-    shader.SetMatrix4x4("projection", proj);
-    shader.SetMatrix4x4("view", view);
-    shader.SetVector3("cameraPosition", camTM.GetTranslation());
     shader.SetVector3("ambient", glm::vec3(ambient));
 
-    // Lighting uniform data
-    for (unsigned int i = 0; i < lights.size(); i++)
+    // the instanced and LOD fading variants are their own programs, so they need their own copies of the uniforms set above
+    Shader& fadeShader = shader.Variant({ "USE_LOD_FADE" });
+    for (Shader* variant : { &shader.Variant({ "USE_INSTANCING" }), &fadeShader, &fadeShader.Variant({ "USE_INSTANCING" }) })
     {
-        shader.SetUint("lights[" + to_string(i) + "].Type", lights[i].Type);
-        shader.SetVector3("lights[" + to_string(i) + "].Direction", lights[i].Direction);
-        shader.SetFloat("lights[" + to_string(i) + "].Range", lights[i].Range);
-        shader.SetVector3("lights[" + to_string(i) + "].Position", lights[i].Position);
-        shader.SetFloat("lights[" + to_string(i) + "].Intensity", lights[i].Intensity);
-        shader.SetVector3("lights[" + to_string(i) + "].Color", lights[i].Color);
-        shader.SetFloat("lights[" + to_string(i) + "].SpotFalloff", lights[i].SpotFalloff);
+        variant->use();
+        variant->SetVector3("ambient", glm::vec3(ambient));
     }
 
-    Scene::Get().Render(shader);
+    Scene::Get().Render(shader, view, proj);
 
     // render to the screen
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDisable(GL_DEPTH_TEST);
+    state.BindFramebuffer(0);
+    state.SetDepthTest(false);
     glClearColor(1.f, 1.f, 1.f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT);
 
     // use SSR shader to use newly rendered textures from above for the final result
     ssrShader.use();
-
-    ssrShader.SetMatrix4x4("projection", proj);
-    ssrShader.SetMatrix4x4("view", view);
     ssrShader.SetVector4("ambient", ambient);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorTex);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTex);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, depthTex);
+    state.BindTexture(0, colorTex);
+    state.BindTexture(1, normalTex);
+    state.BindTexture(2, depthTex);
     
     ssrTri.Draw(ssrShader);
 }
@@ -280,6 +299,9 @@ void reshape(GLFWwindow* window, int w, int h)
 
 int main(int argc, char* argv[])
 {
+    if (argc > 2 && string(argv[1]) == "--forest")
+        forestSize = atoi(argv[2]);
+
     // initialize GLFW
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -318,8 +340,20 @@ int main(int argc, char* argv[])
     while (!glfwWindowShouldClose(window))
     {
         Tick();
+        AssetLoader::Get().Update();
         display();
 
+        // show how many GL state changes the render state cache skipped
+        const RenderStats& stats = RenderState::Get().GetLastFrameStats();
+        const CullingStats& culling = Scene::Get().GetCullingStats();
+        stringstream ss;
+        ss << "Screen Space Reflections [" << stats.issuedCalls << " state changes, " << stats.avoidedCalls << " skipped, ";
+        ss << culling.visible << " objects visible, " << culling.culled << " culled";
+        if (AssetLoader::Get().GetPendingCount())
+            ss << ", loading " << AssetLoader::Get().GetPendingCount() << " assets";
+        ss << "]";
+        glfwSetWindowTitle(window, ss.str().c_str());
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
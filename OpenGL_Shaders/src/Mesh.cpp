@@ -1,5 +1,14 @@
 #include "Mesh.h"
 #include "Light.h"
+#include "ObjLoader.h"
+
+#include "ABCore/MeshSimplifier.h"
+#include "ABCore/NormalGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 Mesh::Mesh() 
 {
@@ -21,33 +30,8 @@ void Mesh::computeNormals()
 	fnormals = new vec3[tri_num];
 	vnormals = new vec3[vert_num];
 
-	vec3 a, b, n;
-
-	// Compute face normals
-	for (unsigned int i = 0; i < tri_num; i++) {
-		
-		a = vertices[triangles[i][1]] - vertices[triangles[i][0]];
-		b = vertices[triangles[i][2]] - vertices[triangles[i][0]];
-		
-		n = cross(a, b);
-		fnormals[i] = normalize(n);
-	}
-
-	// Compute vertex normals
-	for (unsigned int i = 0; i < vert_num; i++) {
-		vnormals[i] = vec3(0.0f);
-	}
-
-	for (unsigned int i = 0; i < tri_num; i++) {
-		for (unsigned int j = 0; j < 3; j++) {
-			vnormals[triangles[i][j]] += fnormals[i];
-		}
-	}
-
-	for (unsigned int i = 0; i < vert_num; i++) {
-		vnormals[i] = normalize(vnormals[i]);
-	}
-
+	// area weighted, in parallel. Vertices are only split where the file's normals are, so keep those edges hard
+	AB::GenerateNormals(&triangles[0][0], tri_num * 3, &vertices[0][0], vert_num, sizeof(vec3), &vnormals[0][0], sizeof(vec3), false, &fnormals[0][0]);
 }
 
 void Mesh::prepareVBOandShaders(const char* v_shader_file, const char* f_shader_file)
@@ -113,69 +97,79 @@ void Mesh::prepareVBOandShaders(const char* v_shader_file, const char* f_shader_
 
 void Mesh::create(const char* filename, const char* v_shader_file, const char* f_shader_file, vec3 position, vec3 scale) {
 
-	vector<vec3> ori_vertices;
-	vector<uvec3> ori_triangles;
-
-    ifstream fs(filename);
-
-    char c;
-    vec3 pos;
-    int index[3];
-	int vid = 0;
-
-    std::string line;
-    while (std::getline(fs, line)) {
-        std::istringstream iss(line);
-
-        iss >> c;
-
-        switch (c) {
-        case 'v':
-			{
-				// read a vertex
-				iss >> pos.x;
-				iss >> pos.y;
-				iss >> pos.z;
-				ori_vertices.push_back(pos);
-				break;
-			}
-        case 'f':
-			{
-				// read a triangle's vertex indices
-				iss >> index[0];
-				iss >> index[1];
-				iss >> index[2];
-				// NOTE: index in obj files starts from 1
-				ori_triangles.push_back(uvec3(index[0] - 1, index[1] -1, index[2] -1));
-				break;
-			}
-        default:
-            // skip the line
-            break;
-        }
-    }
-    fs.close();
-
-	vert_num = ori_vertices.size();
-	tri_num = ori_triangles.size();
+	// the shaders only use positions and normals, so texture coordinates don't need to split vertices
+	ObjData obj;
+	auto start = chrono::steady_clock::now();
+	if (!loadObj(filename, obj, false)) {
+		cout << "ERROR: could not read " << filename << endl;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	struct stat st;
+	double megabytes = stat(filename, &st) == 0 ? st.st_size / (1024.0 * 1024.0) : 0.0;
+	cout << "Loaded " << filename << ": " << obj.vertices.size() << " vertices, " << obj.indices.size() / 3 << " triangles in "
+		<< seconds * 1000.0 << " ms (" << megabytes / std::max(seconds, 1e-6) << " MB/s)" << endl;
+
+	vert_num = obj.vertices.size();
+	tri_num = obj.indices.size() / 3;
 	vertices = new vec3[vert_num];
 	triangles = new uvec3[tri_num];
 
 	// Use arrays to store vertices and triangles, instead of using c++ vectors.
 	// This is because we have to use arrays when sending data to GPUs. 
 	for (uint i = 0; i < vert_num; i++) {
-		vertices[i] = ori_vertices[i];
+		vertices[i] = obj.vertices[i].position;
 	}
 	for (uint i = 0; i < tri_num; i++) {
-		triangles[i] = ori_triangles[i];
+		triangles[i] = uvec3(obj.indices[i * 3], obj.indices[i * 3 + 1], obj.indices[i * 3 + 2]);
 	}
 	
 	modelMat = glm::scale(translate(mat4(1.0), position), scale);
 
 	computeNormals();
+	// the file's normals are the ones the mesh was made with; keep them until simplify changes the surface
+	if (obj.hasNormals) {
+		for (uint i = 0; i < vert_num; i++) {
+			if (obj.vertices[i].normal != vec3(0.0f))
+				vnormals[i] = normalize(obj.vertices[i].normal);
+		}
+	}
 	prepareVBOandShaders(v_shader_file, f_shader_file);
 }
 
+void Mesh::simplify(float ratio, float maxError)
+{
+	if (tri_num == 0)
+		return;
+
+	vector<unsigned int> indices(&triangles[0][0], &triangles[0][0] + tri_num * 3);
+	unsigned int target = (unsigned int)(tri_num * ratio) * 3;
+	float error = 0.0f;
+	vector<unsigned int> simplified = AB::SimplifyMesh(indices, &vertices[0][0], vert_num, sizeof(vec3), target, maxError, &error);
+
+	cout << "Simplified from " << tri_num << " to " << simplified.size() / 3 << " triangles, error " << error << endl;
+
+	tri_num = simplified.size() / 3;
+	delete[] triangles;
+	triangles = new uvec3[tri_num];
+	for (uint i = 0; i < tri_num; i++) {
+		triangles[i] = uvec3(simplified[i * 3], simplified[i * 3 + 1], simplified[i * 3 + 2]);
+	}
+
+	// the normals move with the triangles; vertices that aren't used anymore aren't drawn, whatever their normal
+	delete[] fnormals;
+	delete[] vnormals;
+	computeNormals();
+
+	// the vertices stay where they are on the GPU
+	glBindBuffer(GL_ARRAY_BUFFER, nbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * vert_num, vnormals, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uvec3) * tri_num, triangles, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
 void Mesh::draw(vec3 camPos, mat4 viewMat, mat4 projMat, vector<Light> lights, float time) {
 
 	glMatrixMode(GL_MODELVIEW);
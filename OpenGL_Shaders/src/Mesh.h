@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <set>
+#include <cfloat>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -49,11 +50,16 @@ public:
     Mesh();
     ~Mesh();
 
-    /* Load the mesh from an '.obj' file. All faces need to be triangles.
+    /* Load the mesh from an '.obj' file with loadObj (see ObjLoader.h); polygons are split into triangles.
 	   Attributes like edge lengths and curvatures should be computed when simplifying the mesh.
     */
     void create (const char* filename, const  char* v_shader_file, const char* f_shader_file, vec3 position, vec3 scale);
 
+    /* Simplify the mesh to ratio of its triangles with ABCore's quadric error simplifier (see MeshSimplifier.h),
+	   stopping early if that would move the surface further than maxError. Keeps the vertices; recomputes the normals.
+    */
+    void simplify(float ratio, float maxError = FLT_MAX);
+
     void draw(vec3 camPos, mat4 viewMat, mat4 projMat, vector<Light> lights, float time);
 
 private:
@@ -0,0 +1,442 @@
+#include "ObjLoader.h"
+
+#include "ABCore/MappedFile.h"
+
+#include <thread>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// files are split into chunks of at least this many bytes; on smaller ones starting threads costs more than it saves
+#define MIN_CHUNK_BYTES (1 << 20)
+
+static const unsigned int NO_INDEX = 0xFFFFFFFFu;
+
+enum ObjLine { OTHER_LINE, POSITION_LINE, TEXCOORD_LINE, NORMAL_LINE, FACE_LINE };
+
+// 0-based indices of a face corner's position, texture coordinate and normal; NO_INDEX where it has none
+struct ObjCorner
+{
+	unsigned int v, vt, vn;
+};
+
+// the whole lines between begin and end, parsed by one thread
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+	size_t counts[3] = { 0, 0, 0 };   // 'v', 'vt' and 'vn' lines in this chunk
+	size_t bases[3] = { 0, 0, 0 };    // ... and in the chunks before it
+	vector<ObjCorner> corners;        // three per triangle
+	bool hasTexCoords = false;
+	bool hasNormals = false;
+	size_t badTriangles = 0;
+};
+
+// runs f(0) to f(count - 1) on their own threads
+template<class F> static void parallelFor(unsigned int count, F f)
+{
+	vector<thread> workers;
+	for (unsigned int i = 1; i < count; i++)
+		workers.emplace_back(f, i);
+	f(0);
+	for (thread& worker : workers)
+		worker.join();
+}
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline const char* skipSpaces(const char* p, const char* end)
+{
+	while (p < end && isSpace(*p))
+		p++;
+	return p;
+}
+
+static inline const char* nextLine(const char* p, const char* end)
+{
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+// what a line holds, with p moved past its keyword
+static inline ObjLine lineType(const char*& p, const char* end)
+{
+	p = skipSpaces(p, end);
+	if (end - p < 2)
+		return OTHER_LINE;
+
+	if (p[0] == 'f' && isSpace(p[1]))
+	{
+		p += 2;
+		return FACE_LINE;
+	}
+	if (p[0] != 'v')
+		return OTHER_LINE;
+	if (isSpace(p[1]))
+	{
+		p += 2;
+		return POSITION_LINE;
+	}
+	if (end - p < 3 || !isSpace(p[2]))
+		return OTHER_LINE;
+	p += 3;
+	return p[-2] == 't' ? TEXCOORD_LINE : p[-2] == 'n' ? NORMAL_LINE : OTHER_LINE;
+}
+
+// parses [sign] digits [. digits] [e [sign] digits], or leaves value at 0 and p where it was.
+// Up to 19 significant digits go into an integer that's scaled once by an exact power of ten, so values come out
+// within a unit in the last place of what strtof gives, at a fraction of the cost.
+static const char* parseFloat(const char* p, const char* end, float& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	value = 0.0f;
+	const char* start = p = skipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool any = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+			exponent++;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!any)
+		return start;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			negativeExponent = *q++ == '-';
+		if (q < end && *q >= '0' && *q <= '9')
+		{
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; q++)
+				e = std::min(e * 10 + (*q - '0'), 10000);
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent >= 0)
+		result *= exponent <= 22 ? powers[exponent] : pow(10.0, exponent);
+	else
+		result = -exponent <= 22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+// parses [sign] digits, or leaves value at 0 (never a valid OBJ index) and p where it was
+static inline const char* parseIndex(const char* p, const char* end, long long& value)
+{
+	value = 0;
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p == end || *p < '0' || *p > '9')
+		return start;
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+		value = std::min(value * 10 + (*p - '0'), 1ll << 40);
+	if (negative)
+		value = -value;
+	return p;
+}
+
+// OBJ indices count from 1, or back from the last element before the line if negative; seen is how many that is
+static inline unsigned int resolveIndex(long long index, size_t seen, bool& bad)
+{
+	if (index == 0)
+		return NO_INDEX;
+	long long resolved = index > 0 ? index - 1 : (long long)seen + index;
+	if (resolved < 0 || resolved >= NO_INDEX)
+	{
+		bad = true;
+		return NO_INDEX;
+	}
+	return (unsigned int)resolved;
+}
+
+static void countLines(ObjChunk& chunk)
+{
+	for (const char* line = chunk.begin; line < chunk.end; line = nextLine(line, chunk.end))
+	{
+		const char* p = line;
+		ObjLine type = lineType(p, chunk.end);
+		if (type >= POSITION_LINE && type <= NORMAL_LINE)
+			chunk.counts[type - POSITION_LINE]++;
+	}
+}
+
+// parses the chunk's elements into its ranges of the file's arrays, and its faces into triangles
+static void parseChunk(ObjChunk& chunk, vec3* positions, vec2* texCoords, vec3* normals, bool useTexCoords)
+{
+	size_t seen[3] = { chunk.bases[0], chunk.bases[1], chunk.bases[2] };
+	vector<ObjCorner> polygon;
+
+	for (const char* line = chunk.begin; line < chunk.end; )
+	{
+		const char* end = nextLine(line, chunk.end);
+		const char* p = line;
+		ObjLine type = lineType(p, end);
+		line = end;
+
+		switch (type)
+		{
+		case POSITION_LINE:
+			{
+				vec3& position = positions[seen[0]++];
+				p = parseFloat(p, end, position.x);
+				p = parseFloat(p, end, position.y);
+				parseFloat(p, end, position.z);
+				break;
+			}
+		case TEXCOORD_LINE:
+			{
+				if (useTexCoords)
+				{
+					vec2& texCoord = texCoords[seen[1]];
+					p = parseFloat(p, end, texCoord.x);
+					parseFloat(p, end, texCoord.y);
+				}
+				seen[1]++;
+				break;
+			}
+		case NORMAL_LINE:
+			{
+				vec3& normal = normals[seen[2]++];
+				p = parseFloat(p, end, normal.x);
+				p = parseFloat(p, end, normal.y);
+				parseFloat(p, end, normal.z);
+				break;
+			}
+		case FACE_LINE:
+			{
+				// v, v/vt, v//vn or v/vt/vn per corner
+				polygon.clear();
+				bool bad = false;
+				while (true)
+				{
+					long long v, vt = 0, vn = 0;
+					p = parseIndex(skipSpaces(p, end), end, v);
+					if (v == 0)
+						break;
+					if (p < end && *p == '/')
+					{
+						p = parseIndex(p + 1, end, vt);
+						if (p < end && *p == '/')
+							p = parseIndex(p + 1, end, vn);
+					}
+
+					ObjCorner corner;
+					corner.v = resolveIndex(v, seen[0], bad);
+					corner.vt = useTexCoords ? resolveIndex(vt, seen[1], bad) : NO_INDEX;
+					corner.vn = resolveIndex(vn, seen[2], bad);
+					chunk.hasTexCoords |= corner.vt != NO_INDEX;
+					chunk.hasNormals |= corner.vn != NO_INDEX;
+					polygon.push_back(corner);
+				}
+
+				if (bad)
+				{
+					chunk.badTriangles += polygon.size() >= 3 ? polygon.size() - 2 : 1;
+					break;
+				}
+				for (size_t i = 2; i < polygon.size(); i++)
+				{
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i - 1]);
+					chunk.corners.push_back(polygon[i]);
+				}
+				break;
+			}
+		default:
+			break;
+		}
+	}
+}
+
+static inline size_t hashCorner(const ObjCorner& corner)
+{
+	unsigned long long h = corner.v * 0x9E3779B97F4A7C15ull ^ corner.vt * 0xC2B2AE3D27D4EB4Full ^ corner.vn * 0x165667B19E3779F9ull;
+	return (size_t)(h ^ (h >> 29));
+}
+
+bool loadObj(const char* filename, ObjData& obj, bool texCoords, unsigned int threadCount)
+{
+	obj = ObjData();
+
+	AB::MappedFile file(filename);
+	if (!file.data)
+		return false;
+
+	if (!threadCount)
+		threadCount = std::max(1u, thread::hardware_concurrency());
+	threadCount = (unsigned int)std::max<size_t>(1, std::min<size_t>(threadCount, file.size / MIN_CHUNK_BYTES));
+
+	// split into chunks of whole lines
+	const char* fileEnd = file.data + file.size;
+	vector<ObjChunk> chunks(threadCount);
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		chunks[i].begin = i == 0 ? file.data : nextLine(file.data + file.size * i / threadCount, fileEnd);
+		if (i > 0)
+			chunks[i - 1].end = chunks[i].begin;
+	}
+	chunks.back().end = fileEnd;
+
+	// count the elements first so every chunk knows where its own go, and what its relative indices refer to
+	parallelFor(threadCount, [&](unsigned int i) { countLines(chunks[i]); });
+	size_t totals[3] = { 0, 0, 0 };
+	for (ObjChunk& chunk : chunks)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			chunk.bases[i] = totals[i];
+			totals[i] += chunk.counts[i];
+		}
+	}
+
+	vector<vec3> positions(totals[0]);
+	vector<vec2> texCoordArray(texCoords ? totals[1] : 0);
+	vector<vec3> normals(totals[2]);
+	parallelFor(threadCount, [&](unsigned int i) { parseChunk(chunks[i], positions.data(), texCoordArray.data(), normals.data(), texCoords); });
+
+	size_t cornerCount = 0, badTriangles = 0;
+	for (const ObjChunk& chunk : chunks)
+	{
+		cornerCount += chunk.corners.size();
+		badTriangles += chunk.badTriangles;
+		obj.hasTexCoords |= chunk.hasTexCoords;
+		obj.hasNormals |= chunk.hasNormals;
+	}
+	obj.indices.reserve(cornerCount);
+
+	// with positions only, the file's vertices are the mesh's vertices
+	if (!obj.hasTexCoords && !obj.hasNormals)
+	{
+		obj.vertices.resize(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+			obj.vertices[i] = { positions[i], vec2(0.0f), vec3(0.0f) };
+	}
+
+	// otherwise every distinct corner becomes a vertex, looked up in an open addressing table of vertex indices
+	vector<ObjCorner> keys;
+	vector<unsigned int> slots;
+	size_t mask = 0;
+	auto grow = [&](size_t capacity)
+	{
+		slots.assign(capacity, NO_INDEX);
+		mask = capacity - 1;
+		for (unsigned int i = 0; i < keys.size(); i++)
+		{
+			size_t slot = hashCorner(keys[i]) & mask;
+			while (slots[slot] != NO_INDEX)
+				slot = (slot + 1) & mask;
+			slots[slot] = i;
+		}
+	};
+	if (obj.hasTexCoords || obj.hasNormals)
+	{
+		size_t capacity = 1024;
+		while (capacity < 2 * std::max(totals[0], totals[2]))
+			capacity *= 2;
+		grow(capacity);
+	}
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		for (size_t i = 0; i < chunk.corners.size(); i += 3)
+		{
+			const ObjCorner* triangle = &chunk.corners[i];
+			bool inRange = true;
+			for (int j = 0; j < 3; j++)
+			{
+				inRange &= triangle[j].v < positions.size();
+				inRange &= triangle[j].vt == NO_INDEX || triangle[j].vt < texCoordArray.size();
+				inRange &= triangle[j].vn == NO_INDEX || triangle[j].vn < normals.size();
+			}
+			if (!inRange)
+			{
+				badTriangles++;
+				continue;
+			}
+
+			for (int j = 0; j < 3; j++)
+			{
+				const ObjCorner& corner = triangle[j];
+				if (slots.empty())
+				{
+					obj.indices.push_back(corner.v);
+					continue;
+				}
+
+				size_t slot = hashCorner(corner) & mask;
+				while (slots[slot] != NO_INDEX)
+				{
+					const ObjCorner& key = keys[slots[slot]];
+					if (key.v == corner.v && key.vt == corner.vt && key.vn == corner.vn)
+						break;
+					slot = (slot + 1) & mask;
+				}
+
+				unsigned int index = slots[slot];
+				if (index == NO_INDEX)
+				{
+					index = slots[slot] = (unsigned int)keys.size();
+					keys.push_back(corner);
+					// keep the table at most half full
+					if (keys.size() * 2 > slots.size())
+						grow(slots.size() * 2);
+				}
+				obj.indices.push_back(index);
+			}
+		}
+	}
+
+	if (!keys.empty())
+	{
+		obj.vertices.resize(keys.size());
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			const ObjCorner& key = keys[i];
+			ObjVertex& vertex = obj.vertices[i];
+			vertex.position = positions[key.v];
+			vertex.texCoord = key.vt == NO_INDEX ? vec2(0.0f) : texCoordArray[key.vt];
+			vertex.normal = key.vn == NO_INDEX ? vec3(0.0f) : normals[key.vn];
+		}
+	}
+
+	if (badTriangles)
+		cout << "ERROR: " << filename << ": skipped " << badTriangles << " triangles with out of range indices" << endl;
+	return true;
+}
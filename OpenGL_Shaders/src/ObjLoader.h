@@ -0,0 +1,36 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+struct ObjVertex
+{
+	vec3 position;
+	vec2 texCoord;  // zero where the face corner has none
+	vec3 normal;    // zero where the face corner has none
+};
+
+struct ObjData
+{
+	vector<ObjVertex> vertices;
+	vector<unsigned int> indices;  // triangles
+	bool hasTexCoords = false;     // whether any face corner has a texture coordinate
+	bool hasNormals = false;       // whether any face corner has a normal
+};
+
+/* Load the 'v', 'vt', 'vn' and 'f' lines of an '.obj' file; everything else is skipped.
+   Faces may be "v", "v/vt", "v//vn" or "v/vt/vn" with negative (relative) indices, and polygons are split into fans.
+   Every distinct v/vt/vn combination becomes one vertex, numbered in the order the faces first use them; faces with
+   positions only keep the file's vertices as they are. Without texCoords, 'vt' is ignored so vertices are only split
+   where the normals are.
+
+   The file is memory mapped and split into one chunk of lines per thread (threadCount 0 uses every core), which are
+   parsed in parallel with hand-written number parsing. Returns false if the file can't be read.
+*/
+bool loadObj(const char* filename, ObjData& obj, bool texCoords = true, unsigned int threadCount = 0);
+
+#endif
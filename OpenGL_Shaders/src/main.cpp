@@ -9,6 +9,7 @@
 // Displacement shader - a special fireball visual effects with Perlin noise function
 // Toon shading shader - catoonish rendering effects
 // Per-vertex shading v.s. per-fragment shading = visual comparison between two types of shading 
+// Press L to simplify the meshes to half their triangles
 
 #include <GL/glew.h>
 #ifdef __APPLE__
@@ -213,6 +214,11 @@ void keyboard(unsigned char key, int x, int y)
 		case 'e':
 			pointLights[index].position.y += 0.1f;
 			break;
+		case 'l':
+			// halve the teapots' triangles
+			for (auto& m : g_mesh)
+				m.simplify(0.5f);
+			break;
 	}
 }
 
@@ -6,13 +6,18 @@
 //                                                                                                     \\
 // My implementation of radiosity works as follows:                                                    \\
 //                                                                                                     \\
-// 1. Before the first iteration, add all patches' emissions to their final color.                     \\
-// 2. At the beginning of an iteration, all patches emit their "emission" light to all other patches.  \\
-// 3. At the end of an iteration, the emission of all patches is set to (0,0,0).                       \\
-// 4. Resulting exitance from that iteration becomes the patch's new emission for the next iteration.  \\
-// 5. This exitance is also added to that patch's final color.                                         \\
-// 6. The exitences are all set to (0,0,0) for the next iteration.                                     \\
-// 7. Repeat from step 2 for as many iterations as you want.                                           \\
+// 1. Every input quad becomes a patch, and a hemicube is rendered from each one with patch ids        \\
+//    written to an integer attachment. Each patch's share of the pixels becomes a sparse form         \\
+//    factor row.                                                                                      \\
+// 2. The form factor rows and the solved colors are kept in a bake cache on disk, so a launch only    \\
+//    re-renders the rows whose geometry changed, and only re-solves if anything feeding into it did.  \\
+// 3. Each iteration every patch gathers the light its sources sent out in the previous one over its   \\
+//    row (one bounce per iteration), split across threads. What it gathered is added to its final     \\
+//    color and becomes what it sends out in the next iteration.                                       \\
+// 4. The patches are merged into one smooth-shaded mesh with the final colors on its vertices.        \\
+//                                                                                                     \\
+// Running with --hierarchical links adaptively subdivided elements instead of hemicube rows (see      \\
+// HIERARCHICAL RADIOSITY below). That mode is solved from scratch on every launch.                    \\
 //                                                                                                     \\
 // --------------------------------------------------------------------------------------------------- \\
 
@@ -35,9 +40,22 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cfloat>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define RADIOSITY_SSE
+#endif
 
 #include <ABCore/Scene.h>
 #include <ABCore/Input.h>
+#include <ABCore/UniformBuffer.h>
+#include <ABCore/RenderState.h>
 
 using namespace std;
 using namespace AB;
@@ -61,16 +79,60 @@ struct Patch
     vector<Patch*> adjacents;
     float area;
     unsigned int id;
+    // hash of the patch's corners, used to match it against the bake cache
+    uint64_t hash;
 
     // maps each other patch in the scene to their form factors
     unordered_map<unsigned int, float> formFactors;
 };
 
+struct Element;
+
+// A link along which an element gathers light from another element (hierarchical mode)
+struct Link
+{
+    Element* source;
+    // form factor from the receiver to the source, visibility included
+    float formFactor;
+    // form factor ignoring occlusion; the refinement oracle uses this for partially visible pairs
+    float unoccluded;
+    // fraction of sample rays between the two elements that were not blocked
+    float visibility;
+};
+
+// An input quad, in world space (hierarchical mode)
+struct Quad
+{
+    glm::vec3 corners[4];
+};
+
+// A node in the quadtree built over each merged input quad (hierarchical mode)
+struct Element
+{
+    glm::vec3 corners[4];
+    glm::vec3 normal;
+    glm::vec3 center;
+    float area;
+    int depth;
+
+    glm::vec3 emission;
+    glm::vec3 reflectance = glm::vec3(1);
+    // total radiosity of this element
+    glm::vec3 radiosity;
+    // radiosity gathered over this element's own links during the current iteration
+    glm::vec3 gathered;
+
+    Element* children[4];
+    vector<Link> links;
+};
+
 // the window's width and height
 int width = 1280, height = 720;
 
 Shader shader;
 Shader compute;
+Shader bakedShader;
+UniformBuffer frameUBO;
 vector<Patch> patches;
 GLFWwindow* window;
 
@@ -80,6 +142,44 @@ float dt, oldT;
 float camSpeed = 3.f;
 glm::vec3 lightColor = glm::vec3(30, 30, 30);
 
+// Hierarchical radiosity settings. When enabled (--hierarchical), neighbouring coplanar input quads are merged into
+// large quads, each the root of a quadtree which is only subdivided where the light transported over a link is large
+// enough to matter. It isn't cached, so the default is the hemicube bake, which only re-renders and re-solves what
+// changed since the last launch.
+bool hierarchical = false;
+deque<Element> elements; // storage for every element so pointers to them stay valid
+vector<Element*> roots;
+vector<Element*> occluders;        // the scene's roots, in world space, which visibility rays are tested against
+float hrMinArea = 0.f;             // elements aren't split below this area
+const int HR_MAX_DEPTH = 4;        // how many times an element can be split past the size of the smallest input quad
+const float HR_MAX_ROOT_ASPECT = 4.f; // merged roots can't get longer than this many times their width
+const int HR_VISIBILITY_RAYS = 4;  // rays cast between 2 elements to estimate visibility
+const int HR_REFINE_PASSES = 4;    // max number of solve -> refine passes
+float hrBFEpsilon = 0.25f;         // links transporting more than this (B * F) get refined
+
+// The whole baked scene, merged into one vertex buffer so it can be drawn in a single call.
+// When smoothShading is on, patches sharing a vertex average their colors there instead of being drawn flat.
+bool smoothShading = true;
+unsigned int bakedVAO, bakedVBO, bakedEBO;
+unsigned int bakedIndexCount;
+
+// FNV-1a
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t HashPatchGeometry(const glm::vec3 positions[4])
+{
+    return HashBytes(positions, sizeof(glm::vec3) * 4);
+}
+
 Patch CreatePatch(glm::vec3 positions[4], glm::vec3 emission)
 {
     Patch p = {};
@@ -118,34 +218,48 @@ Patch CreatePatch(glm::vec3 positions[4], glm::vec3 emission)
     p.area = glm::length(glm::cross(v0, v1)) / 2.f + glm::length(glm::cross(v2, v3)) / 2.f;
     p.emission = emission;
     p.id = patches.size() + 1; // patch's id is its index in the patch vector + 1
+    p.hash = HashPatchGeometry(positions);
 
     return p;
 }
 
-// turn the patch's id into a color passable to the frag shader
-glm::vec3 ToColor(unsigned int id)
+// Precomputes the delta form factor of every pixel of a hemicube face, for the top face and for the
+// side faces (whose bottom half is under the patch and so contributes nothing)
+void ComputeDeltaFormFactors(int hemicubeSize, vector<float>& top, vector<float>& side)
 {
-    return glm::vec3(id / (255 * 255) % 255, id / 255 % 255, id % 255);
-}
-// revert a color from the framebuffer back to the id of the patch that rendered it
-unsigned int FromColor(glm::vec3 c)
-{
-    return c.r * 255 * 255 + c.g * 255 + c.b;
+    top.resize(hemicubeSize * hemicubeSize);
+    side.resize(hemicubeSize * hemicubeSize);
+    for (int j = 0; j < hemicubeSize; j++)
+    {
+        for (int i = 0; i < hemicubeSize; i++)
+        {
+            // i,j = 0,0 should correspond to x,y = -1,-1
+            float x = (float)i / (float)hemicubeSize * 2.f - 1.f; // [-1,1]
+            float y = (float)j / (float)hemicubeSize * 2.f - 1.f; // [-1,1]
+
+            float dF = (1.f / (float)(hemicubeSize * hemicubeSize)) /
+                (glm::pi<float>() * glm::pow((1.f + x * x + y * y), 2.f));
+            top[j * hemicubeSize + i] = dF;
+            side[j * hemicubeSize + i] = dF * glm::max(y, 0.f);
+        }
+    }
 }
 
-void Bake(int iterations, int hemicubeSize)
+// Renders a hemicube from every dirty patch to (re)compute its row of form factors
+void RenderFormFactors(int hemicubeSize, const vector<bool>& dirty)
 {
-    // Create framebuffer for rendering colors to
-    unsigned int framebuffer, colorTex, depthStencil;
+    // Create framebuffer for rendering patch ids to
+    unsigned int framebuffer, idTex, depthStencil;
+    RenderState& state = RenderState::Get();
     glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    state.BindFramebuffer(framebuffer);
 
-    glGenTextures(1, &colorTex);
-    glBindTexture(GL_TEXTURE_2D, colorTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, hemicubeSize, hemicubeSize, 0, GL_RGB, GL_FLOAT, 0);
+    glGenTextures(1, &idTex);
+    state.BindTexture(0, idTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, hemicubeSize, hemicubeSize, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTex, 0);
 
     glGenRenderbuffers(1, &depthStencil);
     glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
@@ -162,101 +276,1036 @@ void Bake(int iterations, int hemicubeSize)
         return;
     }
 
-    glEnable(GL_DEPTH_TEST);
+    state.SetDepthTest(true);
     glReadBuffer(GL_COLOR_ATTACHMENT0);
     glViewport(0, 0, hemicubeSize, hemicubeSize);
 
     shader.use();
-    shader.SetMatrix4x4("projection", glm::perspective(glm::radians(90.f), 1.f, 0.1f, 100.f));
+    FrameData frame = {};
+    frame.projection = glm::perspective(glm::radians(90.f), 1.f, 0.1f, 100.f);
     shader.SetInt("size", hemicubeSize);
 
+    vector<float> topDeltas, sideDeltas;
+    ComputeDeltaFormFactors(hemicubeSize, topDeltas, sideDeltas);
+    vector<unsigned int> ids(hemicubeSize * hemicubeSize);
+    const unsigned int clearId[4] = { 0, 0, 0, 0 }; // id of 0 is reserved for nothing being rendered
+    UniformHandle patchIdUniform = shader.GetUniform("patchId");
+
     // Determine form factors
     int i = 0;
+    size_t dirtyCount = count(dirty.begin(), dirty.end(), true);
     for (Patch& pi : patches)
     {
-        cout << "Calculating form factors for patch " << ++i << " of " << patches.size() << "..." << endl;
+        if (!dirty[pi.id - 1]) continue;
+
+        cout << "Calculating form factors for patch " << ++i << " of " << dirtyCount << "..." << endl;
+        pi.formFactors.clear();
         for (int viewI = 0; viewI < 5; viewI++)
         {
-            glClearColor(0.f, 0.f, 0.f, 0.f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glClearBufferuiv(GL_COLOR, 0, clearId);
+            glClear(GL_DEPTH_BUFFER_BIT);
             // for side views, the bottom half ends up under the patch, so render top half only
             shader.SetBool("topHalf", viewI != 0);
-            shader.SetMatrix4x4("view", pi.views[viewI]);
+            frame.view = pi.views[viewI];
+            frame.cameraPosition = pi.center;
+            frameUBO.Upload(frame);
             shader.SetMatrix4x4("world", glm::mat4());
 
             for (Patch& pj : patches)
             {
                 if (&pj == &pi) continue;
 
-                shader.SetVector3("albedoColor", ToColor(pj.id));
+                shader.SetUint(patchIdUniform, pj.id);
                 pj.mesh.Draw(shader);
             }
 
-            glm::vec3* colors = new glm::vec3[hemicubeSize * hemicubeSize];
-            glReadPixels(0, 0, hemicubeSize, hemicubeSize, GL_RGB, GL_FLOAT, colors);
+            glReadPixels(0, 0, hemicubeSize, hemicubeSize, GL_RED_INTEGER, GL_UNSIGNED_INT, ids.data());
 
-            // read the resulting pixels to get total form factor
-            for (int j = 0; j < hemicubeSize; j++)
+            // sum up the pixels each patch covers to get its form factor
+            const vector<float>& deltas = viewI == 0 ? topDeltas : sideDeltas;
+            for (size_t k = 0; k < ids.size(); k++)
             {
-                for (int i = 0; i < hemicubeSize; i++)
-                {
-                    // i,j = 0,0 should correspond to x,y = -1,-1
-                    float x = (float)i / (float)hemicubeSize * 2.f - 1.f; // [-1,1]
-                    float y = (float)j / (float)hemicubeSize * 2.f - 1.f; // [-1,1]
-
-                    float dF = ((viewI == 0 ? 1.f : glm::max(y, 0.f)) / (float)(hemicubeSize * hemicubeSize)) /
-                        (glm::pi<float>() * glm::pow((1.f + x * x + y * y), 2.f));
-                    glm::vec3 c = colors[j * hemicubeSize + i];
-                    pi.formFactors[FromColor(c)] += dF;
-                }
+                if (ids[k] != 0)
+                    pi.formFactors[ids[k]] += deltas[k];
             }
-            delete[] colors;
         }
-        pi.finalColor = pi.emission;
     }
 
-    // Send flux from each patch to each other patch
+    // cleanup
+    state.BindFramebuffer(0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &idTex);
+    state.OnTextureDeleted(idTex);
+    glDeleteRenderbuffers(1, &depthStencil);
+    glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+}
+
+// --------------------------------------------------------------------------------------------------- \\
+//                                                                                                     \\
+// Parallel solver: the solve runs in the gather formulation. Each receiver sums the light of every    \\
+// source that reaches it, so threads only ever write to their own receivers and need no atomics.      \\
+//                                                                                                     \\
+// - The form factor rows are transposed once into receiver-major CSR, with A(i)/A(j) folded in.       \\
+// - Colors are kept in SoA arrays with RGB packed as one SIMD register per patch.                     \\
+// - Receivers are split across threads so each thread gets about the same number of entries.          \\
+//                                                                                                     \\
+// --------------------------------------------------------------------------------------------------- \\
+
+// RGB of one patch plus padding, so it loads straight into one SSE register
+struct Spectrum
+{
+    float r, g, b, pad;
+};
+
+// Everything the solve touches, transposed and flattened out of the patches
+struct SolverData
+{
+    // receiver j gathers over entries [rowStart[j], rowStart[j + 1])
+    vector<unsigned int> rowStart;
+    vector<unsigned int> sources;
+    // F(ij) * A(i) / A(j)
+    vector<float> weights;
+
+    vector<Spectrum> emission;
+    vector<Spectrum> reflectance;
+    vector<float> area;
+    vector<Spectrum> incident;
+    vector<Spectrum> exitance;
+    vector<Spectrum> finalColor;
+};
+
+Spectrum ToSpectrum(const glm::vec3& v)
+{
+    return { v.x, v.y, v.z, 0 };
+}
+
+// Builds the receiver-major form factor matrix and SoA color arrays from the patches
+SolverData BuildSolverData()
+{
+    size_t n = patches.size();
+    SolverData data;
+    data.emission.resize(n);
+    data.reflectance.resize(n);
+    data.area.resize(n);
+    for (Patch& p : patches)
+    {
+        data.emission[p.id - 1] = ToSpectrum(p.emission);
+        data.reflectance[p.id - 1] = ToSpectrum(p.reflectance);
+        data.area[p.id - 1] = p.area;
+    }
+
+    // count the entries of each receiver, then prefix sum them into row offsets
+    data.rowStart.assign(n + 1, 0);
+    for (Patch& pi : patches)
+        for (auto& pair : pi.formFactors)
+            if (pair.first != 0) data.rowStart[pair.first]++;
+    for (size_t j = 0; j < n; j++)
+        data.rowStart[j + 1] += data.rowStart[j];
+
+    data.sources.resize(data.rowStart[n]);
+    data.weights.resize(data.rowStart[n]);
+    vector<unsigned int> cursor(data.rowStart.begin(), data.rowStart.end() - 1);
+    for (Patch& pi : patches)
+    {
+        for (auto& pair : pi.formFactors)
+        {
+            if (pair.first == 0) continue; // id of 0 is reserved for nothing being rendered
+            unsigned int j = pair.first - 1;
+            unsigned int k = cursor[j]++;
+            data.sources[k] = pi.id - 1;
+            data.weights[k] = pair.second * data.area[pi.id - 1] / data.area[j];
+        }
+    }
+    return data;
+}
+
+// Gathers one bounce into receivers [begin, end)
+void GatherRange(SolverData& data, size_t begin, size_t end)
+{
+    const unsigned int* sources = data.sources.data();
+    const float* weights = data.weights.data();
+    const Spectrum* exitance = data.exitance.data();
+
+    for (size_t j = begin; j < end; j++)
+    {
+        unsigned int first = data.rowStart[j], last = data.rowStart[j + 1];
+#ifdef RADIOSITY_SSE
+        __m128 sum = _mm_setzero_ps();
+        for (unsigned int k = first; k < last; k++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(&exitance[sources[k]].r)));
+
+        __m128 incident = _mm_mul_ps(sum, _mm_loadu_ps(&data.reflectance[j].r));
+        _mm_storeu_ps(&data.incident[j].r, incident);
+        _mm_storeu_ps(&data.finalColor[j].r, _mm_add_ps(_mm_loadu_ps(&data.finalColor[j].r), incident));
+#else
+        float r = 0, g = 0, b = 0;
+        for (unsigned int k = first; k < last; k++)
+        {
+            const Spectrum& e = exitance[sources[k]];
+            r += weights[k] * e.r;
+            g += weights[k] * e.g;
+            b += weights[k] * e.b;
+        }
+        Spectrum& incident = data.incident[j];
+        incident.r = r * data.reflectance[j].r;
+        incident.g = g * data.reflectance[j].g;
+        incident.b = b * data.reflectance[j].b;
+        data.finalColor[j].r += incident.r;
+        data.finalColor[j].g += incident.g;
+        data.finalColor[j].b += incident.b;
+#endif
+    }
+}
+
+// Runs the bounces, splitting the receivers over threadCount threads
+void RunSolver(SolverData& data, int iterations, unsigned int threadCount)
+{
+    size_t n = data.emission.size();
+    data.exitance = data.emission;
+    data.finalColor = data.emission;
+    data.incident.assign(n, Spectrum{ 0, 0, 0, 0 });
+
+    // split the receivers so that each thread gathers over about the same number of entries
+    threadCount = std::max(1u, threadCount);
+    vector<size_t> bounds(threadCount + 1, n);
+    bounds[0] = 0;
+    size_t entries = data.rowStart[n];
+    for (unsigned int t = 1; t < threadCount; t++)
+    {
+        size_t target = entries * t / threadCount;
+        bounds[t] = lower_bound(data.rowStart.begin(), data.rowStart.end() - 1, target) - data.rowStart.begin();
+    }
+
+    vector<thread> workers;
     for (int i = 0; i < iterations; i++)
     {
-        cout << "Beginning flux output iteration " << i << "..." << endl;
-        for (Patch& pi : patches)
+        workers.clear();
+        for (unsigned int t = 1; t < threadCount; t++)
+            workers.emplace_back(GatherRange, ref(data), bounds[t], bounds[t + 1]);
+        GatherRange(data, bounds[0], bounds[1]);
+        for (thread& worker : workers)
+            worker.join();
+
+        // what each patch received this bounce is what it sends out next bounce
+        swap(data.exitance, data.incident);
+    }
+}
+
+// Sends flux from each patch to each other patch over the form factors
+void Solve(int iterations)
+{
+    double start = glfwGetTime();
+    SolverData data = BuildSolverData();
+    unsigned int threadCount = std::max(1u, thread::hardware_concurrency());
+    RunSolver(data, iterations, threadCount);
+
+    for (Patch& p : patches)
+    {
+        const Spectrum& c = data.finalColor[p.id - 1];
+        p.finalColor = glm::vec3(c.r, c.g, c.b);
+        p.incident = glm::vec3(0);
+    }
+    cout << "Solved " << iterations << " bounces over " << data.sources.size() << " form factors on "
+        << threadCount << " threads in " << glfwGetTime() - start << "s" << endl;
+}
+
+// Times the solver on synthetic scenes of 10k, 50k and 200k patches. Run with --bench-solver.
+void BenchmarkSolver()
+{
+    const size_t patchCounts[] = { 10000, 50000, 200000 };
+    const unsigned int entriesPerRow = 64;
+    const int iterations = 16;
+    unsigned int threadCount = std::max(1u, thread::hardware_concurrency());
+
+    for (size_t n : patchCounts)
+    {
+        // every receiver sees entriesPerRow random sources, with weights summing to less than 1 so it converges
+        SolverData data;
+        unsigned int seed = 1234;
+        auto next = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed; };
+        data.rowStart.resize(n + 1);
+        data.emission.resize(n);
+        data.reflectance.resize(n);
+        data.area.assign(n, 1.0f);
+        for (size_t j = 0; j < n; j++)
         {
-            for (auto& pair : pi.formFactors)
+            data.rowStart[j] = (unsigned int)(j * entriesPerRow);
+            bool light = next() % 100 == 0;
+            data.emission[j] = light ? Spectrum{ 1, 1, 1, 0 } : Spectrum{ 0, 0, 0, 0 };
+            data.reflectance[j] = Spectrum{ 0.4f + (next() % 64) / 128.0f, 0.5f, 0.6f, 0 };
+            for (unsigned int e = 0; e < entriesPerRow; e++)
             {
-                if (pair.first == 0) continue; // id of 0 is reserved for nothing being rendered
-                Patch& pj = patches[pair.first - 1];
-                pj.incident += pi.emission * pj.reflectance * pair.second * (pi.area / pj.area);
+                data.sources.push_back(next() % n);
+                data.weights.push_back(0.8f / entriesPerRow);
             }
         }
-        // Set each patch to emit their resulting exident light (incident * reflectance) for next iteration.
-        // also add this exident light to their final color.
+        data.rowStart[n] = (unsigned int)data.sources.size();
+
+        auto start = chrono::steady_clock::now();
+        RunSolver(data, iterations, 1);
+        double single = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        RunSolver(data, iterations, threadCount);
+        double parallel = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << n << " patches, " << data.sources.size() << " form factors, " << iterations << " bounces: "
+            << single * 1000 << "ms on 1 thread, " << parallel * 1000 << "ms on " << threadCount << " threads" << endl;
+    }
+}
+
+// --------------------------------------------------------------------------------------------------- \\
+//                                                                                                     \\
+// Bake cache: the form factor matrix (one sparse row per patch) and the solved colors get written     \\
+// to disk so the next launch can skip the hemicube renders.                                           \\
+//                                                                                                     \\
+// - Rows are matched to patches by a hash of the patch's geometry, so they survive reordering.        \\
+// - A row is re-rendered if its own patch is new, if it references a patch that moved or was removed, \\
+//   or if a new patch appeared in front of it (it may now see or be occluded by that patch).          \\
+// - The solve is keyed by emission, reflectance and iteration count, so changing only lightColor      \\
+//   or reflectances re-runs the (cheap) solve against the cached matrix.                              \\
+//                                                                                                     \\
+// --------------------------------------------------------------------------------------------------- \\
+
+const char* BAKE_CACHE_PATH = "radiosity_bake.cache";
+const unsigned int BAKE_CACHE_MAGIC = 0x4B414252; // "RBAK"
+const unsigned int BAKE_CACHE_VERSION = 1;
+
+struct BakeCache
+{
+    int hemicubeSize = 0;
+    vector<uint64_t> hashes; // geometry hash of the patch each row belongs to (row k = patch id k + 1)
+    vector<vector<pair<unsigned int, float>>> rows;
+    uint64_t solveKey = 0;
+    vector<glm::vec3> colors;
+};
+
+// Everything besides the form factors that affects the solve's result
+uint64_t SolveKey(int iterations)
+{
+    uint64_t key = HashBytes(&iterations, sizeof(iterations));
+    for (Patch& p : patches)
+    {
+        key = HashBytes(&p.hash, sizeof(p.hash), key);
+        key = HashBytes(&p.emission, sizeof(glm::vec3), key);
+        key = HashBytes(&p.reflectance, sizeof(glm::vec3), key);
+    }
+    return key;
+}
+
+bool LoadBakeCache(BakeCache& cache)
+{
+    ifstream file(BAKE_CACHE_PATH, ios::binary);
+    if (!file) return false;
+
+    unsigned int magic = 0, version = 0, patchCount = 0, colorCount = 0;
+    file.read((char*)&magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    if (magic != BAKE_CACHE_MAGIC || version != BAKE_CACHE_VERSION)
+    {
+        cout << "Radiosity bake cache is from a different version, ignoring it." << endl;
+        return false;
+    }
+    file.read((char*)&cache.hemicubeSize, sizeof(cache.hemicubeSize));
+    file.read((char*)&patchCount, sizeof(patchCount));
+
+    cache.hashes.resize(patchCount);
+    cache.rows.resize(patchCount);
+    for (unsigned int i = 0; i < patchCount && file; i++)
+    {
+        unsigned int entryCount = 0;
+        file.read((char*)&cache.hashes[i], sizeof(uint64_t));
+        file.read((char*)&entryCount, sizeof(entryCount));
+        cache.rows[i].resize(entryCount);
+        file.read((char*)cache.rows[i].data(), entryCount * sizeof(pair<unsigned int, float>));
+    }
+
+    file.read((char*)&cache.solveKey, sizeof(cache.solveKey));
+    file.read((char*)&colorCount, sizeof(colorCount));
+    cache.colors.resize(colorCount);
+    file.read((char*)cache.colors.data(), colorCount * sizeof(glm::vec3));
+
+    if (!file)
+    {
+        cout << "Radiosity bake cache is truncated, ignoring it." << endl;
+        return false;
+    }
+    return true;
+}
+
+void SaveBakeCache(int hemicubeSize, uint64_t solveKey)
+{
+    ofstream file(BAKE_CACHE_PATH, ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "ERROR: Could not write radiosity bake cache to " << BAKE_CACHE_PATH << endl;
+        return;
+    }
+
+    unsigned int patchCount = patches.size();
+    file.write((const char*)&BAKE_CACHE_MAGIC, sizeof(BAKE_CACHE_MAGIC));
+    file.write((const char*)&BAKE_CACHE_VERSION, sizeof(BAKE_CACHE_VERSION));
+    file.write((const char*)&hemicubeSize, sizeof(hemicubeSize));
+    file.write((const char*)&patchCount, sizeof(patchCount));
+
+    vector<pair<unsigned int, float>> row;
+    for (Patch& p : patches)
+    {
+        row.assign(p.formFactors.begin(), p.formFactors.end());
+        unsigned int entryCount = row.size();
+        file.write((const char*)&p.hash, sizeof(p.hash));
+        file.write((const char*)&entryCount, sizeof(entryCount));
+        file.write((const char*)row.data(), entryCount * sizeof(pair<unsigned int, float>));
+    }
+
+    file.write((const char*)&solveKey, sizeof(solveKey));
+    file.write((const char*)&patchCount, sizeof(patchCount));
+    for (Patch& p : patches)
+        file.write((const char*)&p.finalColor, sizeof(glm::vec3));
+}
+
+// Fills in the form factors of every patch whose cached row is still valid. Returns which rows need rendering.
+vector<bool> ReuseCachedRows(const BakeCache& cache)
+{
+    const unsigned int REMOVED = 0xFFFFFFFF;
+    vector<bool> dirty(patches.size(), true);
+
+    unordered_map<uint64_t, unsigned int> idByHash;
+    for (Patch& p : patches)
+        idByHash[p.hash] = p.id;
+
+    // map the old patch ids onto the new ones; 0 (nothing rendered) stays 0
+    vector<unsigned int> newIds(cache.hashes.size() + 1, REMOVED);
+    newIds[0] = 0;
+    unordered_map<uint64_t, bool> oldHashes;
+    for (size_t k = 0; k < cache.hashes.size(); k++)
+    {
+        auto it = idByHash.find(cache.hashes[k]);
+        if (it != idByHash.end())
+            newIds[k + 1] = it->second;
+        oldHashes[cache.hashes[k]] = true;
+    }
+
+    for (size_t k = 0; k < cache.rows.size(); k++)
+    {
+        unsigned int id = newIds[k + 1];
+        if (id == REMOVED) continue;
+
+        Patch& p = patches[id - 1];
+        p.formFactors.clear();
+        bool valid = true;
+        for (auto& entry : cache.rows[k])
+        {
+            unsigned int target = entry.first < newIds.size() ? newIds[entry.first] : REMOVED;
+            if (target == REMOVED)
+            {
+                valid = false; // this patch could see one that has since moved or been removed
+                break;
+            }
+            p.formFactors[target] += entry.second;
+        }
+        if (valid)
+            dirty[id - 1] = false;
+        else
+            p.formFactors.clear();
+    }
+
+    // new patches might show up in (or occlude part of) any hemicube they're in front of
+    for (Patch& added : patches)
+    {
+        if (oldHashes.count(added.hash)) continue;
+
         for (Patch& p : patches)
         {
-            p.emission = p.incident;
-            p.finalColor += p.incident;
-            p.incident = glm::vec3(0); // reset for next iteration
+            if (!dirty[p.id - 1] && glm::dot(added.center - p.center, p.normal) > 0.f)
+            {
+                dirty[p.id - 1] = true;
+                p.formFactors.clear();
+            }
         }
     }
+    return dirty;
+}
 
-    // cleanup
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &framebuffer);
-    glDeleteTextures(1, &colorTex);
-    glDeleteRenderbuffers(1, &depthStencil);
-    glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+void Bake(int iterations, int hemicubeSize)
+{
+    vector<bool> dirty(patches.size(), true);
+
+    BakeCache cache;
+    bool cached = LoadBakeCache(cache) && cache.hemicubeSize == hemicubeSize;
+    if (cached)
+        dirty = ReuseCachedRows(cache);
+
+    size_t dirtyCount = count(dirty.begin(), dirty.end(), true);
+    cout << "Radiosity bake cache: reusing " << patches.size() - dirtyCount << " of " << patches.size() << " form factor rows" << endl;
+    if (dirtyCount > 0)
+        RenderFormFactors(hemicubeSize, dirty);
+
+    // only re-solve if the matrix or anything else feeding into the solve changed
+    uint64_t solveKey = SolveKey(iterations);
+    if (cached && dirtyCount == 0 && cache.solveKey == solveKey && cache.colors.size() == patches.size())
+    {
+        cout << "Radiosity bake cache: reusing solved colors" << endl;
+        for (Patch& p : patches)
+            p.finalColor = cache.colors[p.id - 1];
+    }
+    else
+    {
+        Solve(iterations);
+    }
+
+    SaveBakeCache(hemicubeSize, solveKey);
+}
+
+// --------------------------------------------------------------------------------------------------- \\
+//                                                                                                     \\
+//                      ================ HIERARCHICAL RADIOSITY =================                      \\
+//                                                                                                     \\
+// --------------------------------------------------------------------------------------------------- \\
+//                                                                                                     \\
+// Based on Hanrahan, Salzman & Aupperle '91. Instead of every quad being linked to every other quad:  \\
+//                                                                                                     \\
+// 1. Neighbouring coplanar input quads are merged into large root quads, so a flat wall starts out as \\
+//    one element however finely it was modelled. Every pair of roots is linked, unless the link       \\
+//    transports too much light (B * F). In that case the bigger of the 2 gets split into 4 and its    \\
+//    children are linked instead, down to a few levels finer than the input quads.                    \\
+// 2. Each iteration, every element gathers light over its own links (at whatever level they're at).   \\
+// 3. Push-pull: gathered light is pushed down to the leaves, then area-averaged back up to parents.   \\
+// 4. After solving, links are re-checked against the new radiosities and refined where needed,        \\
+//    then everything is solved again. Partially occluded links (shadow edges) refine more eagerly.    \\
+//                                                                                                     \\
+// --------------------------------------------------------------------------------------------------- \\
+
+Element* CreateElement(const glm::vec3 positions[4], glm::vec3 emission, int depth = 0)
+{
+    elements.push_back({});
+    Element& e = elements.back();
+
+    for (int i = 0; i < 4; i++)
+    {
+        e.corners[i] = positions[i];
+        e.center += positions[i];
+        e.children[i] = nullptr;
+    }
+    e.center /= 4.f;
+
+    glm::vec3 v0 = positions[1] - positions[0];
+    glm::vec3 v1 = positions[2] - positions[1];
+    glm::vec3 v2 = positions[3] - positions[2];
+    glm::vec3 v3 = positions[0] - positions[3];
+    e.normal = glm::normalize(glm::cross(v0, v1));
+    e.area = glm::length(glm::cross(v0, v1)) / 2.f + glm::length(glm::cross(v2, v3)) / 2.f;
+
+    e.depth = depth;
+    e.emission = emission;
+    e.radiosity = emission;
+    return &e;
+}
+
+// point on the element's quad at the bilinear coords (u, v)
+glm::vec3 ElementPoint(const Element& e, float u, float v)
+{
+    return glm::mix(glm::mix(e.corners[0], e.corners[1], u), glm::mix(e.corners[3], e.corners[2], u), v);
+}
+
+// Identifies an edge by its quantized end points, so float noise doesn't keep neighbouring quads apart
+struct EdgeKey
+{
+    glm::ivec3 from;
+    glm::ivec3 to;
+
+    bool operator==(const EdgeKey& other) const
+    {
+        return from == other.from && to == other.to;
+    }
+};
+struct EdgeKeyHash
+{
+    size_t operator()(const EdgeKey& key) const
+    {
+        return (size_t)HashBytes(&key, sizeof(EdgeKey));
+    }
+};
+
+inline glm::ivec3 QuantizePosition(glm::vec3 position)
+{
+    return glm::ivec3(glm::round(position * 10000.f));
+}
+
+// whether b lies on the line through a and c, between them
+bool IsStraight(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+    glm::vec3 ab = b - a, bc = c - b;
+    return glm::dot(ab, bc) > 0.f && glm::length(glm::cross(ab, bc)) <= 0.0001f * glm::length(ab) * glm::length(bc);
+}
+
+glm::vec3 QuadNormal(const Quad& q)
+{
+    return glm::normalize(glm::cross(q.corners[1] - q.corners[0], q.corners[2] - q.corners[1]));
+}
+
+// Merges neighbouring quads that share a whole edge and lie in the same plane, wherever the 2 together make a quad
+// again, until no more can be merged. Every pass, each quad takes part in at most one merge.
+void MergeCoplanarQuads(vector<Quad>& quads)
+{
+    for (bool merged = true; merged;)
+    {
+        merged = false;
+        unordered_map<EdgeKey, pair<size_t, int>, EdgeKeyHash> edges;
+        for (size_t i = 0; i < quads.size(); i++)
+        {
+            for (int k = 0; k < 4; k++)
+                edges[{ QuantizePosition(quads[i].corners[k]), QuantizePosition(quads[i].corners[(k + 1) % 4]) }] = { i, k };
+        }
+
+        vector<bool> taken(quads.size(), false);
+        vector<bool> removed(quads.size(), false);
+        for (size_t i = 0; i < quads.size(); i++)
+        {
+            for (int k = 0; k < 4 && !taken[i]; k++)
+            {
+                // the neighbour over edge A -> B runs along it the other way
+                const glm::vec3* a = quads[i].corners;
+                glm::vec3 A = a[k], B = a[(k + 1) % 4];
+                auto it = edges.find({ QuantizePosition(B), QuantizePosition(A) });
+                if (it == edges.end() || it->second.first == i || taken[it->second.first])
+                    continue;
+
+                size_t j = it->second.first;
+                int m = it->second.second;
+                const glm::vec3* b = quads[j].corners;
+                if (glm::dot(QuadNormal(quads[i]), QuadNormal(quads[j])) < 0.9999f)
+                    continue;
+
+                // around the outside: a[k+2] -> a[k+3] -> A -> b[m+2] -> b[m+3] -> B, a quad if A and B are on straight edges
+                glm::vec3 corners[4] = { a[(k + 2) % 4], a[(k + 3) % 4], b[(m + 2) % 4], b[(m + 3) % 4] };
+                if (!IsStraight(corners[1], A, corners[2]) || !IsStraight(corners[3], B, corners[0]))
+                    continue;
+
+                float side0 = glm::distance(corners[0], corners[1]), side1 = glm::distance(corners[1], corners[2]);
+                if (glm::max(side0, side1) > HR_MAX_ROOT_ASPECT * glm::min(side0, side1))
+                    continue;
+
+                copy(corners, corners + 4, quads[i].corners);
+                taken[i] = taken[j] = true;
+                removed[j] = true;
+                merged = true;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < quads.size(); i++)
+        {
+            if (!removed[i])
+                quads[kept++] = quads[i];
+        }
+        quads.resize(kept);
+    }
+}
+
+// whether the segment from origin, maxDistance along the unit vector dir, passes through the element's quad
+bool SegmentHitsElement(glm::vec3 origin, glm::vec3 dir, float maxDistance, const Element& e)
+{
+    float facing = glm::dot(e.normal, dir);
+    if (glm::abs(facing) < 0.000001f)
+        return false;
+
+    float t = glm::dot(e.center - origin, e.normal) / facing;
+    if (t <= 0.f || t >= maxDistance)
+        return false;
+
+    // the quads are convex, so the point is inside if it's on the inner side of every edge
+    glm::vec3 point = origin + dir * t;
+    for (int i = 0; i < 4; i++)
+    {
+        if (glm::dot(glm::cross(e.corners[(i + 1) % 4] - e.corners[i], point - e.corners[i]), e.normal) < 0.f)
+            return false;
+    }
+    return true;
+}
+
+bool IsOccluded(glm::vec3 from, glm::vec3 to, float offset)
+{
+    glm::vec3 dir = to - from;
+    float dist = glm::length(dir);
+    dir /= dist;
+    for (Element* occluder : occluders)
+    {
+        if (SegmentHitsElement(from, dir, dist - offset, *occluder))
+            return true;
+    }
+    return false;
+}
+
+// elements at least 4 times hrMinArea can still be split into 4
+inline bool CanSubdivide(const Element* e)
+{
+    return e->area >= hrMinArea * 3.99f;
+}
+
+inline float Luminance(glm::vec3 c)
+{
+    return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+// Point-to-disk form factor estimate from the receiver point to the source element
+float FormFactorEstimate(glm::vec3 receiverPoint, glm::vec3 receiverNormal, glm::vec3 sourcePoint, const Element& source)
+{
+    glm::vec3 d = sourcePoint - receiverPoint;
+    float dist2 = glm::dot(d, d);
+    if (dist2 < 0.0000001f)
+        return 0.f;
+
+    d /= glm::sqrt(dist2);
+    float cosR = glm::dot(receiverNormal, d);
+    float cosS = -glm::dot(source.normal, d);
+    if (cosR <= 0.f || cosS <= 0.f)
+        return 0.f;
+
+    return cosR * cosS * source.area / (glm::pi<float>() * dist2 + source.area);
+}
+
+Link CreateLink(Element* receiver, Element* source)
+{
+    // sample points at the centers of each quadrant of the 2 elements
+    static const glm::vec2 samples[HR_VISIBILITY_RAYS] = { { 0.25f, 0.25f }, { 0.75f, 0.25f }, { 0.75f, 0.75f }, { 0.25f, 0.75f } };
+    const float offset = 0.001f;
+
+    Link link = { source, 0.f, 0.f, 0.f };
+    link.unoccluded = FormFactorEstimate(receiver->center, receiver->normal, source->center, *source);
+    if (link.unoccluded <= 0.f)
+        return link;
+
+    // cast rays between the elements, pairing up different quadrants so the rays don't all run parallel
+    int unblocked = 0;
+    for (int i = 0; i < HR_VISIBILITY_RAYS; i++)
+    {
+        glm::vec3 from = ElementPoint(*receiver, samples[i].x, samples[i].y) + receiver->normal * offset;
+        glm::vec3 to = ElementPoint(*source, samples[(i + 2) % HR_VISIBILITY_RAYS].x, samples[(i + 2) % HR_VISIBILITY_RAYS].y) + source->normal * offset;
+        if (!IsOccluded(from, to, offset))
+            unblocked++;
+    }
+    link.visibility = (float)unblocked / (float)HR_VISIBILITY_RAYS;
+    link.formFactor = link.unoccluded * link.visibility;
+    return link;
+}
+
+// BF-refinement oracle: refine if the light carried over the link is too large to be treated as constant.
+// Partially visible links are judged by their unoccluded form factor so that shadow boundaries get refined.
+bool NeedsRefinement(const Link& link)
+{
+    bool partial = link.visibility > 0.f && link.visibility < 1.f;
+    float ff = partial ? link.unoccluded : link.formFactor;
+    return Luminance(link.source->radiosity) * ff > hrBFEpsilon;
+}
+
+void Subdivide(Element* e)
+{
+    if (e->children[0]) return;
+
+    glm::vec3 mid[4];
+    for (int i = 0; i < 4; i++)
+        mid[i] = (e->corners[i] + e->corners[(i + 1) % 4]) / 2.f;
+
+    // keep the same winding as the parent
+    glm::vec3 quads[4][4] =
+    {
+        { e->corners[0], mid[0], e->center, mid[3] },
+        { mid[0], e->corners[1], mid[1], e->center },
+        { e->center, mid[1], e->corners[2], mid[2] },
+        { mid[3], e->center, mid[2], e->corners[3] }
+    };
+    for (int i = 0; i < 4; i++)
+    {
+        Element* child = CreateElement(quads[i], e->emission, e->depth + 1);
+        child->reflectance = e->reflectance;
+        child->radiosity = e->radiosity;
+        e->children[i] = child;
+    }
+}
+
+void Refine(Element* receiver, Element* source)
+{
+    Link link = CreateLink(receiver, source);
+    if (link.unoccluded <= 0.f) return; // elements face away from each other
+
+    bool canSplitReceiver = CanSubdivide(receiver);
+    bool canSplitSource = CanSubdivide(source);
+    if (NeedsRefinement(link) && (canSplitReceiver || canSplitSource))
+    {
+        // split whichever element is bigger and link its children instead
+        if (canSplitSource && (!canSplitReceiver || source->area > receiver->area))
+        {
+            Subdivide(source);
+            for (Element* child : source->children)
+                Refine(receiver, child);
+        }
+        else
+        {
+            Subdivide(receiver);
+            for (Element* child : receiver->children)
+                Refine(child, source);
+        }
+        return;
+    }
+    receiver->links.push_back(link);
+}
+
+// Re-checks every link in the hierarchy with the latest radiosities. Returns whether anything got refined.
+bool RefineLinks(Element* receiver)
+{
+    bool refined = false;
+
+    vector<Link> oldLinks;
+    oldLinks.swap(receiver->links);
+    for (Link& link : oldLinks)
+    {
+        bool canSplit = CanSubdivide(receiver) || CanSubdivide(link.source);
+        if (canSplit && NeedsRefinement(link))
+        {
+            // Refine() will re-create this link further down the hierarchy
+            Refine(receiver, link.source);
+            refined = true;
+        }
+        else
+        {
+            receiver->links.push_back(link);
+        }
+    }
+
+    if (receiver->children[0])
+    {
+        for (Element* child : receiver->children)
+            refined = RefineLinks(child) || refined;
+    }
+    return refined;
+}
+
+void ResetRadiosity(Element* e)
+{
+    e->radiosity = e->emission;
+    if (e->children[0])
+    {
+        for (Element* child : e->children)
+            ResetRadiosity(child);
+    }
+}
+
+void Gather(Element* e)
+{
+    e->gathered = glm::vec3(0);
+    for (Link& link : e->links)
+        e->gathered += link.formFactor * link.source->radiosity;
+    e->gathered *= e->reflectance;
+
+    if (e->children[0])
+    {
+        for (Element* child : e->children)
+            Gather(child);
+    }
+}
+
+// Pushes the light gathered by parents down to the leaves, then pulls the area-weighted average back up
+glm::vec3 PushPull(Element* e, glm::vec3 down)
+{
+    if (!e->children[0])
+    {
+        e->radiosity = e->emission + e->gathered + down;
+        return e->radiosity;
+    }
+
+    glm::vec3 up = glm::vec3(0);
+    for (Element* child : e->children)
+        up += PushPull(child, e->gathered + down) * (child->area / e->area);
+    e->radiosity = up;
+    return up;
+}
+
+void SolveHierarchical(int iterations)
+{
+    // each iteration adds one more bounce, same as the hemicube solver
+    for (Element* root : roots)
+        ResetRadiosity(root);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        for (Element* root : roots)
+            Gather(root);
+        for (Element* root : roots)
+            PushPull(root, glm::vec3(0));
+    }
+}
+
+void CollectLeaves(Element* e, vector<Element*>& leaves)
+{
+    if (!e->children[0])
+    {
+        leaves.push_back(e);
+        return;
+    }
+    for (Element* child : e->children)
+        CollectLeaves(child, leaves);
+}
+
+void BakeHierarchical(int iterations)
+{
+    // link every pair of input quads, refining wherever the emitters make it necessary
+    cout << "Linking " << roots.size() << " elements..." << endl;
+    for (Element* receiver : roots)
+    {
+        for (Element* source : roots)
+        {
+            if (receiver != source)
+                Refine(receiver, source);
+        }
+    }
+
+    // solve, then refine the links again using the new radiosities until nothing changes
+    SolveHierarchical(iterations);
+    for (int pass = 0; pass < HR_REFINE_PASSES; pass++)
+    {
+        cout << "Refinement pass " << pass << " (" << elements.size() << " elements)..." << endl;
+        bool refined = false;
+        for (Element* root : roots)
+            refined = RefineLinks(root) || refined;
+
+        if (!refined) break;
+        SolveHierarchical(iterations);
+    }
+
+    // the leaves become the patches that get displayed
+    vector<Element*> leaves;
+    for (Element* root : roots)
+        CollectLeaves(root, leaves);
+
+    size_t linkCount = 0;
+    for (Element& e : elements)
+        linkCount += e.links.size();
+    cout << "Hierarchical bake done: " << roots.size() << " roots, " << leaves.size() << " leaves, " << linkCount << " links" << endl;
+
+    patches.clear();
+    patches.reserve(leaves.size());
+    for (Element* leaf : leaves)
+    {
+        patches.push_back(CreatePatch(leaf->corners, leaf->emission));
+        patches.back().reflectance = leaf->reflectance;
+        patches.back().finalColor = leaf->radiosity;
+    }
+}
+
+// A vertex of the merged, baked scene
+struct BakedVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Color;
+};
+
+// Identifies a shared vertex by its position and normal, quantized so float noise doesn't split it.
+// Including the normal keeps the colors of different walls from bleeding into each other at the corners.
+struct WeldKey
+{
+    glm::ivec3 position;
+    glm::ivec3 normal;
+
+    bool operator==(const WeldKey& other) const
+    {
+        return position == other.position && normal == other.normal;
+    }
+};
+struct WeldKeyHash
+{
+    size_t operator()(const WeldKey& key) const
+    {
+        return (size_t)HashBytes(&key, sizeof(WeldKey));
+    }
+};
+
+// Merges every patch into one mesh. Each vertex gets the area-weighted average radiosity of the patches sharing it.
+void ExportBakedMesh()
+{
+    vector<BakedVertex> vertices;
+    vector<float> weights;
+    vector<unsigned int> indices;
+    unordered_map<WeldKey, unsigned int, WeldKeyHash> welded;
+
+    vertices.reserve(patches.size() * 4);
+    weights.reserve(patches.size() * 4);
+    indices.reserve(patches.size() * 6);
+    for (Patch& p : patches)
+    {
+        unsigned int corners[4];
+        for (int i = 0; i < 4; i++)
+        {
+            glm::vec3 position = p.mesh.vertices[i].Position;
+            unsigned int index = vertices.size();
+            if (smoothShading)
+            {
+                WeldKey key = { glm::ivec3(glm::round(position * 10000.f)), glm::ivec3(glm::round(p.normal * 100.f)) };
+                auto it = welded.find(key);
+                if (it != welded.end())
+                    index = it->second;
+                else
+                    welded[key] = index;
+            }
+            if (index == vertices.size())
+            {
+                vertices.push_back({ position, glm::vec3(0) });
+                weights.push_back(0.f);
+            }
+
+            vertices[index].Color += p.finalColor * p.area;
+            weights[index] += p.area;
+            corners[i] = index;
+        }
+        // same winding as the patch meshes
+        indices.insert(indices.end(), { corners[0], corners[1], corners[2], corners[0], corners[2], corners[3] });
+    }
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        if (weights[i] > 0.f)
+            vertices[i].Color /= weights[i];
+    }
+
+    if (!bakedVAO)
+    {
+        glGenVertexArrays(1, &bakedVAO);
+        glGenBuffers(1, &bakedVBO);
+        glGenBuffers(1, &bakedEBO);
+    }
+    RenderState::Get().BindVertexArray(bakedVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, bakedVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BakedVertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bakedEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    // vPos
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BakedVertex), (void*)0);
+    // vColor
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BakedVertex), (void*)offsetof(BakedVertex, Color));
+
+    RenderState::Get().BindVertexArray(0);
+    bakedIndexCount = indices.size();
+
+    cout << "Exported baked scene: " << patches.size() << " patches -> " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles" << endl;
 }
 
 void init()
 {
     stbi_set_flip_vertically_on_load(true);
 
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    RenderState::Get().SetCullFace(true);
+    RenderState::Get().SetDepthTest(true);
 
     oldT = glfwGetTime();
 
     // set up shader
     shader = Shader("../ABCore/Shaders/vertex.vert", "../ABCore/Shaders/frag_unlit.frag");
+    // camera data for both the hemicube renders and the display
+    frameUBO = UniformBuffer(sizeof(FrameData), FRAME_DATA_BINDING);
+
     // light patch
     glm::vec3 lightV[4] =
     {
@@ -265,16 +1314,21 @@ void init()
         glm::vec3(-0.5f, 2.97f, -5.5f),
         glm::vec3(0.9f, 2.97f, -5.5f)
     };
-    patches.push_back(CreatePatch(lightV, lightColor));
+    if (hierarchical)
+        roots.push_back(CreateElement(lightV, lightColor));
+    else
+        patches.push_back(CreatePatch(lightV, lightColor));
 
     // set up scene model
     GameObject* scene = Scene::Get().Add(GameObject("../Assets/cornell-box-holes2-subdivided2.obj", "Cornell Box"));
     scene->SetWorldTM({ 3, -2.5f, -2 }, glm::quat({ glm::pi<float>() / 2.f, glm::pi<float>(), glm::pi<float>() }));
 
-    // Patch generation
+    // Patch generation. The scene's own vertices stay in object space; the patches and elements get world space copies.
     glm::mat4 world = scene->GetWorldTM().GetMatrix();
-    for (Mesh& m : scene->GetMeshes())
+    vector<Quad> quads;
+    for (auto& mesh : scene->GetMeshes())
     {
+        Mesh& m = *mesh;
         for (int i = 0; i < m.indices.size(); i += 6)
         {
             // every 6 indices = 0, 1, 2, 0, 2, 3, so just use 0, 1, 2, and 5 to get the 4 verts
@@ -285,10 +1339,40 @@ void init()
                 glm::vec3(world * glm::vec4(m.vertices[m.indices[i + 2]].Position, 1)),
                 glm::vec3(world * glm::vec4(m.vertices[m.indices[i + 5]].Position, 1))
             };
-            patches.push_back(CreatePatch(verts, glm::vec3(0)));
+            if (hierarchical)
+                quads.push_back({ { verts[0], verts[1], verts[2], verts[3] } });
+            else
+                patches.push_back(CreatePatch(verts, glm::vec3(0)));
         }
     }
-    Bake(16, 256);
+
+    if (hierarchical)
+    {
+        // the input tessellation only limits how fine the elements get, not how coarse
+        float smallest = FLT_MAX;
+        for (Quad& q : quads)
+            smallest = glm::min(smallest, glm::length(glm::cross(q.corners[1] - q.corners[0], q.corners[2] - q.corners[0])));
+        hrMinArea = smallest / (float)(1 << (2 * HR_MAX_DEPTH));
+
+        size_t inputCount = quads.size();
+        MergeCoplanarQuads(quads);
+        cout << "Merged " << inputCount << " input quads into " << quads.size() << " roots" << endl;
+
+        // the merged quads cover the same surfaces as the input, so visibility rays are tested against them
+        for (Quad& q : quads)
+        {
+            roots.push_back(CreateElement(q.corners, glm::vec3(0)));
+            occluders.push_back(roots.back());
+        }
+        BakeHierarchical(16);
+    }
+    else
+    {
+        Bake(16, 256);
+    }
+
+    bakedShader = Shader("../ABCore/Shaders/vert_color.vert", "../ABCore/Shaders/frag_color.frag");
+    ExportBakedMesh();
 }
 
 void Tick()
@@ -299,7 +1383,8 @@ void Tick()
 
     // display FPS
     stringstream ss;
-    ss << "Radiosity" << " [" << 1.f / dt << " FPS]";
+    const RenderStats& stats = RenderState::Get().GetLastFrameStats();
+    ss << "Radiosity" << " [" << 1.f / dt << " FPS, " << stats.avoidedCalls << " GL calls skipped]";
     glfwSetWindowTitle(window, ss.str().c_str());
 
     if (Input::Get().MouseButtonDown(GLFW_MOUSE_BUTTON_2))
@@ -337,6 +1422,8 @@ void Tick()
 // called when the GL context need to be rendered
 void display(void)
 {
+    RenderState::Get().BeginFrame();
+
     // clear the screen to white, which is the background color
     glClearColor(0.1f, 0.1f, 0.1f, 0.f);
 
@@ -344,18 +1431,18 @@ void display(void)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // use the shader program
-    shader.use();
-
-    shader.SetMatrix4x4("projection", glm::perspective(glm::radians(80.f), (float)width / (float)height, 0.1f, 1000.f));
-    shader.SetMatrix4x4("view", glm::lookAt(camTM.GetTranslation(), camTM.GetTranslation() - camTM.GetForward(), glm::vec3(0.f, 1.f, 0.f)));
-    shader.SetBool("topHalf", false);
-    shader.SetMatrix4x4("world", glm::mat4());
-
-    for (Patch& p : patches)
-    {
-        shader.SetVector3("albedoColor", p.finalColor);
-        p.mesh.Draw(shader);
-    }
+    bakedShader.use();
+
+    FrameData frame = {};
+    frame.projection = glm::perspective(glm::radians(80.f), (float)width / (float)height, 0.1f, 1000.f);
+    frame.view = glm::lookAt(camTM.GetTranslation(), camTM.GetTranslation() - camTM.GetForward(), glm::vec3(0.f, 1.f, 0.f));
+    frame.cameraPosition = camTM.GetTranslation();
+    frameUBO.Upload(frame);
+    bakedShader.SetMatrix4x4("world", glm::mat4());
+
+    // the whole baked scene is one draw
+    RenderState::Get().BindVertexArray(bakedVAO);
+    glDrawElements(GL_TRIANGLES, bakedIndexCount, GL_UNSIGNED_INT, 0);
 }
 
 // called when window is first created or when window is resized
@@ -371,6 +1458,14 @@ void reshape(GLFWwindow* window, int w, int h)
 
 int main(int argc, char* argv[])
 {
+    if (argc > 1 && string(argv[1]) == "--bench-solver")
+    {
+        BenchmarkSolver();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--hierarchical")
+        hierarchical = true;
+
     // initialize GLFW
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);